@@ -714,6 +714,24 @@ genfskStatus_t GENFSK_CancelPendingTx(void);
  */
 genfskStatus_t GENFSK_StartRx(uint8_t instanceId, uint8_t *pBuffer, uint16_t maxBufLengthBytes, GENFSK_timestamp_t rxStartTime, GENFSK_timestamp_t rxDuration);
 
+/*!
+ * @brief Starts a continuous receive operation.
+ *
+ * This function starts receiving like GENFSK_StartRx() with no timeout, but the LL re-arms
+ * the receiver itself as soon as each packet is read out of packet RAM. Packets are stored
+ * in the buffers of ppBuffers in turn, so the buffer passed to the packet received callback
+ * stays untouched until bufferCount - 1 more packets have arrived.
+ * Reception stops on GENFSK_CancelPendingRx(), GENFSK_AbortAll() or GENFSK_StartRx().
+ *
+ * @param instanceId The ID of the instance.
+ * @param ppBuffers Array of bufferCount pointers to buffers used for reception.
+ * @param bufferCount The number of buffers in ppBuffers.
+ * @param maxBufLengthBytes The allocated size of each buffer for the maximum packet length that can be received.
+ *
+ * @retval gGenfskSuccess_c if success or the failure reason.
+ */
+genfskStatus_t GENFSK_StartRxContinuous(uint8_t instanceId, uint8_t **ppBuffers, uint8_t bufferCount, uint16_t maxBufLengthBytes);
+
 /*!
  * @brief Cancels pending RX events.
  *
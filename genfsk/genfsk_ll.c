@@ -106,6 +106,9 @@ static inline void GENFSK_Command(GENFSK_sequence_commands command);
 /*! @brief GENFSK RX timeout callback function. */
 static void GENFSK_RxTimeoutCallback(void);
 
+/*! @brief Ends an RX sequence, re-arming the receiver in continuous mode. */
+static uint8_t *GENFSK_RxRearm(void);
+
 /*! @brief GENFSK LL Task. */
 static void GENFSK_Task(osaTaskParam_t argument);
 
@@ -1667,6 +1670,7 @@ genfskStatus_t GENFSK_StartRx(uint8_t instanceId, uint8_t *pBuffer, uint16_t max
                 
                 genfskLocal[instanceId].genfskRxLocal.rxPacketBuffer = pBuffer;
                 genfskLocal[instanceId].genfskRxLocal.rxMaxPacketLength = maxBufLengthBytes;
+                genfskLocal[instanceId].genfskRxLocal.rxContinuous = FALSE;
                 
                 /* Start RX now. */
                 if (!rxStartTime)
@@ -1757,6 +1761,36 @@ genfskStatus_t GENFSK_StartRx(uint8_t instanceId, uint8_t *pBuffer, uint16_t max
     return status;
 }
 
+genfskStatus_t GENFSK_StartRxContinuous(uint8_t instanceId, uint8_t **ppBuffers, uint8_t bufferCount, uint16_t maxBufLengthBytes)
+{
+    genfskStatus_t status = gGenfskSuccess_c;
+    
+    if ((ppBuffers == NULL) || (bufferCount == 0))
+    {
+        status = gGenfskInvalidParameters_c;
+    }
+    else
+    {
+        /* Enter critical section. */
+        OSA_InterruptDisable();
+        
+        status = GENFSK_StartRx(instanceId, ppBuffers[0], maxBufLengthBytes, 0, 0);
+        
+        if (status == gGenfskSuccess_c)
+        {
+            genfskLocal[instanceId].genfskRxLocal.rxBufferRing = ppBuffers;
+            genfskLocal[instanceId].genfskRxLocal.rxBufferCount = bufferCount;
+            genfskLocal[instanceId].genfskRxLocal.rxBufferIdx = 0;
+            genfskLocal[instanceId].genfskRxLocal.rxContinuous = TRUE;
+        }
+        
+        /* Exit critical section. */
+        OSA_InterruptEnable();
+    }
+    
+    return status;
+}
+
 genfskStatus_t GENFSK_CancelPendingRx(void)
 {
     genfskStatus_t status = gGenfskSuccess_c;
@@ -1778,6 +1812,7 @@ genfskStatus_t GENFSK_CancelPendingRx(void)
         
         genfskLocal[mGenfskActiveInstance].genfskRxLocal.rxMaxPacketLength = 0;
         genfskLocal[mGenfskActiveInstance].genfskRxLocal.rxPacketBuffer = NULL;
+        genfskLocal[mGenfskActiveInstance].genfskRxLocal.rxContinuous = FALSE;
         genfskLocal[mGenfskActiveInstance].genfskState = gGENFSK_LL_Idle;
         
         /* Exit critical section. */
@@ -1809,6 +1844,7 @@ genfskStatus_t GENFSK_AbortAll(void)
 
         genfskLocal[mGenfskActiveInstance].genfskRxLocal.rxMaxPacketLength = 0;
         genfskLocal[mGenfskActiveInstance].genfskRxLocal.rxPacketBuffer = NULL;
+        genfskLocal[mGenfskActiveInstance].genfskRxLocal.rxContinuous = FALSE;
         genfskLocal[mGenfskActiveInstance].genfskState = gGENFSK_LL_Idle;
         
         /* Exit critical section. */
@@ -1993,10 +2029,41 @@ genfskStatus_t GENFSK_ByteArrayToPacket(uint8_t instanceId, uint8_t *pBuffer, GE
     return status;
 }
 
+static uint8_t *GENFSK_RxRearm(void)
+{
+    GENFSK_RxLocalStruct_t *pRxLocal = &genfskLocal[mGenfskActiveInstance].genfskRxLocal;
+    uint8_t *pFilled = pRxLocal->rxPacketBuffer;
+    
+    /* Enter critical section. */
+    OSA_InterruptDisable();
+    
+    if (pRxLocal->rxContinuous)
+    {
+        /* The packet is out of packet RAM: listen again at once, into the next buffer. */
+        pRxLocal->rxBufferIdx = (pRxLocal->rxBufferIdx + 1) % pRxLocal->rxBufferCount;
+        pRxLocal->rxPacketBuffer = pRxLocal->rxBufferRing[pRxLocal->rxBufferIdx];
+        genfskLocal[mGenfskActiveInstance].genfskState = gGENFSK_LL_BusyRx;
+        GENFSK_Command(RX_START_NOW);
+    }
+    else
+    {
+        genfskLocal[mGenfskActiveInstance].genfskState = gGENFSK_LL_Idle;
+#if gMWS_Enabled_d
+        MWS_Release(gMWS_GENFSK_c);
+#endif
+    }
+    
+    /* Exit critical section. */
+    OSA_InterruptEnable();
+    
+    return pFilled;
+}
+
 static void GENFSK_Task(osaTaskParam_t argument)
 {    
     uint64_t tempTime = 0;
     uint16_t byteCount = 0;
+    uint8_t *pRxBuffer = NULL;
     uint8_t rssi = 0;
     osaEventFlags_t ev;
     
@@ -2016,10 +2083,7 @@ static void GENFSK_Task(osaTaskParam_t argument)
                 {
                     GENFSK_ReadPacketBuffer(0, genfskLocal[mGenfskActiveInstance].genfskRxLocal.rxPacketBuffer, genfskLocal[mGenfskActiveInstance].genfskRxLocal.rxMaxPacketLength);
                     
-                    genfskLocal[mGenfskActiveInstance].genfskState = gGENFSK_LL_Idle;
-#if gMWS_Enabled_d
-                    MWS_Release(gMWS_GENFSK_c);
-#endif
+                    pRxBuffer = GENFSK_RxRearm();
                     
                     /* Packet received OK but allocated length is smaller than the received length. */
                     if (genfskLocal[mGenfskActiveInstance].eventNotifyCallback != NULL)
@@ -2034,23 +2098,20 @@ static void GENFSK_Task(osaTaskParam_t argument)
                     rssi = (uint8_t)((GENFSK->XCVR_STS & GENFSK_XCVR_STS_RSSI_MASK) >> GENFSK_XCVR_STS_RSSI_SHIFT);
                     tempTime = gGenfskTimerOverflow | GENFSK->TIMESTAMP;
                     
-                    genfskLocal[mGenfskActiveInstance].genfskState = gGENFSK_LL_Idle;                    
-#if gMWS_Enabled_d
-                    MWS_Release(gMWS_GENFSK_c);
-#endif
+                    pRxBuffer = GENFSK_RxRearm();
                     
                     if (genfskLocal[mGenfskActiveInstance].radioConfig.radioMode == gGenfskMsk)
                     {
-                        GENFSK_MskPostProcessing(genfskLocal[mGenfskActiveInstance].genfskRxLocal.rxPacketBuffer,
-                                                 genfskLocal[mGenfskActiveInstance].genfskRxLocal.rxPacketBuffer,
-                                                 byteCount, !(genfskLocal[mGenfskActiveInstance].genfskRxLocal.rxPacketBuffer[0] & 0x01), 1);
+                        GENFSK_MskPostProcessing(pRxBuffer,
+                                                 pRxBuffer,
+                                                 byteCount, !(pRxBuffer[0] & 0x01), 1);
                             
                     }
                     
                     /* Packet received OK. */
                     if (genfskLocal[mGenfskActiveInstance].packetReceivedcallback != NULL)
                     {
-                        genfskLocal[mGenfskActiveInstance].packetReceivedcallback(genfskLocal[mGenfskActiveInstance].genfskRxLocal.rxPacketBuffer, byteCount, tempTime, rssi, FALSE);
+                        genfskLocal[mGenfskActiveInstance].packetReceivedcallback(pRxBuffer, byteCount, tempTime, rssi, FALSE);
                     }
                 }
             }
@@ -2062,16 +2123,13 @@ static void GENFSK_Task(osaTaskParam_t argument)
                     {
                         GENFSK_ReadPacketBuffer(0, genfskLocal[mGenfskActiveInstance].genfskRxLocal.rxPacketBuffer, genfskLocal[mGenfskActiveInstance].genfskRxLocal.rxMaxPacketLength);
                         
-                        genfskLocal[mGenfskActiveInstance].genfskState = gGENFSK_LL_Idle;
-#if gMWS_Enabled_d
-                        MWS_Release(gMWS_GENFSK_c);
-#endif
+                        pRxBuffer = GENFSK_RxRearm();
                         
                         if (genfskLocal[mGenfskActiveInstance].radioConfig.radioMode == gGenfskMsk)
                         {
-                            GENFSK_MskPostProcessing(genfskLocal[mGenfskActiveInstance].genfskRxLocal.rxPacketBuffer,
-                                                     genfskLocal[mGenfskActiveInstance].genfskRxLocal.rxPacketBuffer,
-                                                     byteCount, !(genfskLocal[mGenfskActiveInstance].genfskRxLocal.rxPacketBuffer[0] & 0x01), 1);
+                            GENFSK_MskPostProcessing(pRxBuffer,
+                                                     pRxBuffer,
+                                                     byteCount, !(pRxBuffer[0] & 0x01), 1);
                             
                         }
                         
@@ -2088,23 +2146,20 @@ static void GENFSK_Task(osaTaskParam_t argument)
                         rssi = (uint8_t)((GENFSK->XCVR_STS & GENFSK_XCVR_STS_RSSI_MASK) >> GENFSK_XCVR_STS_RSSI_SHIFT);
                         tempTime = gGenfskTimerOverflow | GENFSK->TIMESTAMP;
                         
-                        genfskLocal[mGenfskActiveInstance].genfskState = gGENFSK_LL_Idle;
-#if gMWS_Enabled_d
-                        MWS_Release(gMWS_GENFSK_c);
-#endif
+                        pRxBuffer = GENFSK_RxRearm();
 
                         if (genfskLocal[mGenfskActiveInstance].radioConfig.radioMode == gGenfskMsk)
                         {
-                            GENFSK_MskPostProcessing(genfskLocal[mGenfskActiveInstance].genfskRxLocal.rxPacketBuffer,
-                                                     genfskLocal[mGenfskActiveInstance].genfskRxLocal.rxPacketBuffer,
-                                                     byteCount, !(genfskLocal[mGenfskActiveInstance].genfskRxLocal.rxPacketBuffer[0] & 0x01), 1);
+                            GENFSK_MskPostProcessing(pRxBuffer,
+                                                     pRxBuffer,
+                                                     byteCount, !(pRxBuffer[0] & 0x01), 1);
                             
                         }
                         
                         /* Packet received OK. */
                         if (genfskLocal[mGenfskActiveInstance].packetReceivedcallback != NULL)
                         {
-                            genfskLocal[mGenfskActiveInstance].packetReceivedcallback(genfskLocal[mGenfskActiveInstance].genfskRxLocal.rxPacketBuffer, byteCount, tempTime, rssi, TRUE);
+                            genfskLocal[mGenfskActiveInstance].packetReceivedcallback(pRxBuffer, byteCount, tempTime, rssi, TRUE);
                         }
                     }
                 }
@@ -2114,16 +2169,13 @@ static void GENFSK_Task(osaTaskParam_t argument)
                     {
                         GENFSK_ReadPacketBuffer(0, genfskLocal[mGenfskActiveInstance].genfskRxLocal.rxPacketBuffer, genfskLocal[mGenfskActiveInstance].genfskRxLocal.rxMaxPacketLength);
                         
-                        genfskLocal[mGenfskActiveInstance].genfskState = gGENFSK_LL_Idle;
-#if gMWS_Enabled_d
-                        MWS_Release(gMWS_GENFSK_c);
-#endif
+                        pRxBuffer = GENFSK_RxRearm();
                         
                         if (genfskLocal[mGenfskActiveInstance].radioConfig.radioMode == gGenfskMsk)
                         {
-                            GENFSK_MskPostProcessing(genfskLocal[mGenfskActiveInstance].genfskRxLocal.rxPacketBuffer,
-                                                     genfskLocal[mGenfskActiveInstance].genfskRxLocal.rxPacketBuffer,
-                                                     byteCount, !(genfskLocal[mGenfskActiveInstance].genfskRxLocal.rxPacketBuffer[0] & 0x01), 1);
+                            GENFSK_MskPostProcessing(pRxBuffer,
+                                                     pRxBuffer,
+                                                     byteCount, !(pRxBuffer[0] & 0x01), 1);
                             
                         }
                         
@@ -2141,39 +2193,33 @@ static void GENFSK_Task(osaTaskParam_t argument)
                             rssi = (uint8_t)((GENFSK->XCVR_STS & GENFSK_XCVR_STS_RSSI_MASK) >> GENFSK_XCVR_STS_RSSI_SHIFT);
                             tempTime = gGenfskTimerOverflow | GENFSK->TIMESTAMP;
       
-                            genfskLocal[mGenfskActiveInstance].genfskState = gGENFSK_LL_Idle;
-#if gMWS_Enabled_d
-                            MWS_Release(gMWS_GENFSK_c);
-#endif
+                            pRxBuffer = GENFSK_RxRearm();
 
                             if (genfskLocal[mGenfskActiveInstance].radioConfig.radioMode == gGenfskMsk)
                             {
-                                GENFSK_MskPostProcessing(genfskLocal[mGenfskActiveInstance].genfskRxLocal.rxPacketBuffer,
-                                                         genfskLocal[mGenfskActiveInstance].genfskRxLocal.rxPacketBuffer,
-                                                         byteCount, !(genfskLocal[mGenfskActiveInstance].genfskRxLocal.rxPacketBuffer[0] & 0x01), 1);
+                                GENFSK_MskPostProcessing(pRxBuffer,
+                                                         pRxBuffer,
+                                                         byteCount, !(pRxBuffer[0] & 0x01), 1);
                             
                             }
                             
                             /* Packet received with CRC invalid. */
                             if (genfskLocal[mGenfskActiveInstance].packetReceivedcallback != NULL)
                             {
-                                genfskLocal[mGenfskActiveInstance].packetReceivedcallback(genfskLocal[mGenfskActiveInstance].genfskRxLocal.rxPacketBuffer, byteCount, tempTime, rssi, FALSE);
+                                genfskLocal[mGenfskActiveInstance].packetReceivedcallback(pRxBuffer, byteCount, tempTime, rssi, FALSE);
                             }
                         }
                         else
                         {
                             GENFSK_ReadPacketBuffer(0, genfskLocal[mGenfskActiveInstance].genfskRxLocal.rxPacketBuffer, genfskLocal[mGenfskActiveInstance].genfskRxLocal.rxMaxPacketLength);
 
-                            genfskLocal[mGenfskActiveInstance].genfskState = gGENFSK_LL_Idle;                            
-#if gMWS_Enabled_d
-                            MWS_Release(gMWS_GENFSK_c);
-#endif
+                            pRxBuffer = GENFSK_RxRearm();
                             
                             if (genfskLocal[mGenfskActiveInstance].radioConfig.radioMode == gGenfskMsk)
                             {
-                                GENFSK_MskPostProcessing(genfskLocal[mGenfskActiveInstance].genfskRxLocal.rxPacketBuffer,
-                                                         genfskLocal[mGenfskActiveInstance].genfskRxLocal.rxPacketBuffer,
-                                                         byteCount, !(genfskLocal[mGenfskActiveInstance].genfskRxLocal.rxPacketBuffer[0] & 0x01), 1);
+                                GENFSK_MskPostProcessing(pRxBuffer,
+                                                         pRxBuffer,
+                                                         byteCount, !(pRxBuffer[0] & 0x01), 1);
                             
                             }
                             
@@ -143,6 +143,10 @@ typedef struct _GENFSK_RxLocalStruct
 {
     uint8_t *rxPacketBuffer;
     uint16_t rxMaxPacketLength;
+    uint8_t **rxBufferRing;     /*!< Continuous mode: buffers filled in turn. */
+    uint8_t rxBufferCount;
+    uint8_t rxBufferIdx;        /*!< Continuous mode: index of rxPacketBuffer in rxBufferRing. */
+    bool_t rxContinuous;        /*!< Re-arm the receiver after every packet. */
 } GENFSK_RxLocalStruct_t;
 
 /*! @brief GENFSK saved registers structure.*/
@@ -44,7 +44,7 @@
  ********************************************************************************** */
 #define CPU_MKW41Z512VHT4               1
 #define FSL_RTOS_FREE_RTOS              1
-#define gTotalHeapSize_c                6000
+#define gTotalHeapSize_c                8000
 
 /*! *********************************************************************************
  * 	Drivers Configuration
@@ -114,7 +114,7 @@
  * 	RTOS Configuration
  ********************************************************************************** */
 /* Defines number of OS events used */
-#define osNumberOfEvents        4
+#define osNumberOfEvents        6
 
 /* Defines number of OS semaphores used */
 #define osNumberOfSemaphores    1
@@ -5,6 +5,7 @@
 #include "xcvr_test_fsk.h"
 #include "SerialManager.h"
 #include "LED.h"
+#include "fsl_os_abstraction.h"
 
 #include "genfsk.h"
 #include "genfsk_states.h"
@@ -27,13 +28,68 @@ ct_config_params_t gaConfigParams[5];
 ********************************************************************************** */
 #define gRadioOpcode1 (0xAB)
 #define gRadioOpcode2 (0xDC)
+/*second opcode byte of the acknowledgement a node returns for a led command*/
+#define gRadioAckOpcode2 (0xAC)
+/*bytes of link statistics an RX node appends to its ACK*/
+#define gRadioLinkStatsLen_c (2 * (4 + gRadioRssiBuckets_c))
+/*log task event bits*/
+#define gRadioLogRecord_c    (1 << 0)
+#define gRadioLogLinkStats_c (1 << 1)
+
+/*number of frames the TX queue holds*/
+#ifndef gRadioTxQueueLen_c
+#define gRadioTxQueueLen_c (8)
+#endif
+
+/*number of buffers the link layer receives into in continuous mode*/
+#ifndef gRadioRxBufferCount_c
+#define gRadioRxBufferCount_c (2)
+#endif
+
+/*received packets the console log can hold, MUST be a power of two*/
+#ifndef gRadioLogLen_c
+#define gRadioLogLen_c (16)
+#endif
+/*the log task runs one level below the application main thread (7), on the level of
+  the idle task, so radio events are always handled before any record is formatted.
+  The idle task never blocks, but the scheduler takes turns between ready tasks of one
+  priority at every switch, and the log task blocks on its event between bursts of at
+  most gRadioLogBurst_c records every gRadioLogPeriodMs_c*/
+#ifndef gRadioLogTaskPriority_c
+#define gRadioLogTaskPriority_c  (8)
+#endif
+#define gRadioLogTaskStackSize_c (512)
+#define gRadioLogBurst_c         (4)
+#define gRadioLogPeriodMs_c      (50)
+
+/************************************************************************************
+* Private type definitions
+************************************************************************************/
+/* one queued radio frame, already packed for GENFSK_StartTx */
+typedef struct radioTxEntry_tag
+{
+    uint8_t buffer[gGenFskDefaultMaxBufferSize_c];
+    uint16_t length;
+    uint16_t index;
+    uint8_t address;
+    GENFSK_timestamp_t queued;
+}radioTxEntry_t;
+
+/* one received packet waiting to be printed */
+typedef struct radioRxLog_tag
+{
+    uint32_t timestamp;
+    uint16_t index;
+    uint8_t address;
+    uint8_t ledState;
+    uint8_t rssi;
+}radioRxLog_t;
 
 /************************************************************************************
 * Private memory declarations
 ************************************************************************************/
-/* buffers for interaction with Generic FSK */
-static uint8_t* gRxBuffer;
-static uint8_t* gTxBuffer;
+/* buffers for interaction with Generic FSK, received into in turn */
+static uint8_t* gaRxBuffers[gRadioRxBufferCount_c];
 
 /* Generic FSK packets to get formatted data*/
 static GENFSK_packet_t gRxPacket;
@@ -44,6 +100,38 @@ static pHookAppNotification pNotifyAppThread = NULL;
 /*hook to notify app thread*/
 static pTmrHookNotification pTmrCallback = NULL;
 
+/*pool of frames waiting for the radio, used as a ring starting at mTxHead*/
+static radioTxEntry_t maTxQueue[gRadioTxQueueLen_c];
+static uint8_t mTxHead = 0;
+static uint8_t mTxCount = 0;
+/*set while the frame at mTxHead is on the air or waiting for its ACK*/
+static bool_t bTxBusy = FALSE;
+static ct_tx_stats_t mTxStats;
+#if gRadioAckEnabled_d
+/*ACK wait for the frame at mTxHead*/
+static bool_t bAckWait = FALSE;
+static uint8_t mTxRetries;
+static GENFSK_timestamp_t mTxSentAt;
+static GENFSK_timestamp_t mAckDeadline;
+/*per node delivery counters, indexed by address*/
+static ct_node_stats_t maNodeStats[gRadioMaxNodes_c];
+/*acknowledgement sent back by an RX node*/
+static uint8_t maAckBuffer[gGenFskDefaultMaxBufferSize_c];
+#endif
+
+/*console log ring: Genfsk_Receive adds at mRxLogHead, Genfsk_LogTask prints from mRxLogTail*/
+static radioRxLog_t maRxLog[gRadioLogLen_c];
+static volatile uint8_t mRxLogHead = 0;
+static volatile uint8_t mRxLogTail = 0;
+/*records lost because the log was full*/
+static volatile uint32_t mRxLogDropped = 0;
+static osaEventId_t mRxLogEvent;
+
+/*RX node: link statistics per transmitter. Entry 0 is the TX node, heard through its
+  commands; entry n is RX node n, heard through its ACKs. CRC failures can't be
+  traced to a sender and are all counted in entry 0*/
+static ct_link_stats_t maLinkStats[gRadioMaxNodes_c];
+
 /*packet configuration*/
 static GENFSK_packet_config_t pktConfig = 
 {
@@ -142,9 +230,10 @@ void GenFskInit(pHookAppNotification pFunc, pTmrHookNotification pTmrFunc)
     
     gaConfigParams[4].paramType = gParamTypeMaxType_c;
     /* allocate once to use for the entire application */
-    gRxBuffer  = MEM_BufferAlloc(gGenFskDefaultMaxBufferSize_c + 
-                                 crcConfig.crcSize);
-    gTxBuffer  = MEM_BufferAlloc(gGenFskDefaultMaxBufferSize_c);
+    for(uint8_t i = 0; i < gRadioRxBufferCount_c; i++) {
+        gaRxBuffers[i] = MEM_BufferAlloc(gGenFskDefaultMaxBufferSize_c + 
+                                         crcConfig.crcSize);
+    }
     
     gRxPacket.payload = (uint8_t*)MEM_BufferAlloc(gGenFskMaxPayloadLen_c  + 
                                                        crcConfig.crcSize);
@@ -174,13 +263,267 @@ void GenFskInit(pHookAppNotification pFunc, pTmrHookNotification pTmrFunc)
     GENFSK_SetChannelNumber(mAppGenfskId, gGenFskDefaultChannel_c);
 }
 
+/*! *********************************************************************************
+* \brief  Packs a radio frame into a byte buffer and returns its length.
+*         extraLen bytes of pExtra follow the 6 byte command payload.
+********************************************************************************** */
+static uint16_t Genfsk_PackFrame(uint8_t* pBuffer, uint16_t u16PacketIndex, uint8_t address, uint8_t ledState, uint8_t opcode2,
+                                 const uint8_t* pExtra, uint8_t extraLen)
+{
+    gTxPacket.header.lengthField = (uint16_t)gaConfigParams[3].paramValue.decValue + extraLen;
+    gTxPacket.payload[0] = (u16PacketIndex >> 8);
+    gTxPacket.payload[1] = (uint8_t)u16PacketIndex;
+    gTxPacket.payload[2] = address;
+    gTxPacket.payload[3] = ledState;
+    gTxPacket.payload[4] = gRadioOpcode1;
+    gTxPacket.payload[5] = opcode2;
+    if(extraLen) {
+        FLib_MemCpy(&gTxPacket.payload[gGenFskMinPayloadLen_c], (void*)pExtra, extraLen);
+    }
+
+    /*pack everything into a buffer*/
+    GENFSK_PacketToByteArray(mAppGenfskId, &gTxPacket, pBuffer);
+    /*calculate buffer length*/
+    return gTxPacket.header.lengthField+
+              (gGenFskDefaultHeaderSizeBytes_c)+
+                  (gGenFskDefaultSyncAddrSize_c + 1);
+}
+
+/*! *********************************************************************************
+* \brief  Returns the histogram bucket of a received signal strength
+********************************************************************************** */
+static uint8_t Genfsk_RssiBucket(uint8_t rssi)
+{
+    int16_t dBm = (int8_t)rssi;
+
+    if(dBm < -90) {
+        return 0;
+    }
+    dBm = (dBm + 100) / 10;
+    return (dBm < gRadioRssiBuckets_c) ? (uint8_t)dBm : (gRadioRssiBuckets_c - 1);
+}
+
+/*! *********************************************************************************
+* \brief  Counts a frame from one transmitter. A repeated packet index is a duplicate,
+*         a jump back means the transmitter restarted. With bSequential a jump forward
+*         counts the skipped indexes as missed; ACKs echo the TX node's index, which
+*         also advances for frames sent to other nodes, so for them it can't.
+********************************************************************************** */
+static void Genfsk_CountRx(ct_link_stats_t* pLink, uint16_t u16PacketIndex, uint8_t rssi, bool_t bSequential)
+{
+    uint16_t step = u16PacketIndex - pLink->lastIndex;
+
+    if(pLink->seen && step == 0) {
+        pLink->duplicates++;
+    } else {
+        if(bSequential && pLink->seen && step < 0x8000) {
+            pLink->missed += step - 1;
+        }
+        pLink->received++;
+        pLink->lastIndex = u16PacketIndex;
+        pLink->seen = TRUE;
+    }
+    if(pLink->rssiHist[Genfsk_RssiBucket(rssi)] != 0xFFFF) {
+        pLink->rssiHist[Genfsk_RssiBucket(rssi)]++;
+    }
+}
+
+/*! *********************************************************************************
+* \brief  Writes the counters of a link as big endian 16 bit words, saturated
+********************************************************************************** */
+static void Genfsk_PackLinkStats(uint8_t* pBuffer, const ct_link_stats_t* pLink)
+{
+    uint32_t words[4 + gRadioRssiBuckets_c];
+    uint8_t i;
+
+    words[0] = pLink->received;
+    words[1] = pLink->missed;
+    words[2] = pLink->duplicates;
+    words[3] = pLink->crcFailed;
+    for(i = 0; i < gRadioRssiBuckets_c; i++) {
+        words[4 + i] = pLink->rssiHist[i];
+    }
+    for(i = 0; i < 4 + gRadioRssiBuckets_c; i++) {
+        if(words[i] > 0xFFFF) {
+            words[i] = 0xFFFF;
+        }
+        *pBuffer++ = (uint8_t)(words[i] >> 8);
+        *pBuffer++ = (uint8_t)words[i];
+    }
+}
+
+/*! *********************************************************************************
+* \brief  Reads link counters written by Genfsk_PackLinkStats
+********************************************************************************** */
+static void Genfsk_UnpackLinkStats(const uint8_t* pBuffer, ct_link_stats_t* pLink)
+{
+    uint16_t words[4 + gRadioRssiBuckets_c];
+    uint8_t i;
+
+    for(i = 0; i < 4 + gRadioRssiBuckets_c; i++) {
+        words[i] = ((uint16_t)pBuffer[0] << 8) | pBuffer[1];
+        pBuffer += 2;
+    }
+    pLink->received = words[0];
+    pLink->missed = words[1];
+    pLink->duplicates = words[2];
+    pLink->crcFailed = words[3];
+    for(i = 0; i < gRadioRssiBuckets_c; i++) {
+        pLink->rssiHist[i] = words[4 + i];
+    }
+    pLink->seen = TRUE;
+}
+
+/*! *********************************************************************************
+* \brief  Prints the link statistics table on the console
+********************************************************************************** */
+static void Genfsk_PrintLinkStats(void)
+{
+    static const char* const rssiLabels[gRadioRssiBuckets_c] = { " <-90:", " -90:", " -80:", " -70:", " -60:", " -50:" };
+    ct_link_stats_t link;
+    uint32_t perMille;
+    uint8_t node, i;
+
+    Serial_Print(mAppSerId, "\r\nLink statistics\r\n", gAllowToBlock_d);
+    for(node = 0; node < gRadioMaxNodes_c; node++) {
+        OSA_InterruptDisable();
+        link = maLinkStats[node];
+        OSA_InterruptEnable();
+        if(!link.seen && (node || !link.crcFailed)) {
+            continue;
+        }
+        if(node) {
+            Serial_Print(mAppSerId, "Node ", gAllowToBlock_d);
+            Serial_PrintDec(mAppSerId, node);
+        } else {
+            Serial_Print(mAppSerId, "TX", gAllowToBlock_d);
+        }
+        Serial_Print(mAppSerId, ": rx ", gAllowToBlock_d);
+        Serial_PrintDec(mAppSerId, link.received);
+        if(!node) {
+            /*only the TX node numbers its frames consecutively*/
+            Serial_Print(mAppSerId, " missed ", gAllowToBlock_d);
+            Serial_PrintDec(mAppSerId, link.missed);
+        }
+        Serial_Print(mAppSerId, " dup ", gAllowToBlock_d);
+        Serial_PrintDec(mAppSerId, link.duplicates);
+        Serial_Print(mAppSerId, " crc ", gAllowToBlock_d);
+        Serial_PrintDec(mAppSerId, link.crcFailed);
+        if(!node) {
+            perMille = (link.received + link.missed) ? (link.missed * 1000) / (link.received + link.missed) : 0;
+            Serial_Print(mAppSerId, " PER ", gAllowToBlock_d);
+            Serial_PrintDec(mAppSerId, perMille / 10);
+            Serial_Print(mAppSerId, ".", gAllowToBlock_d);
+            Serial_PrintDec(mAppSerId, perMille % 10);
+            Serial_Print(mAppSerId, "%", gAllowToBlock_d);
+        }
+        Serial_Print(mAppSerId, " rssi", gAllowToBlock_d);
+        for(i = 0; i < gRadioRssiBuckets_c; i++) {
+            Serial_Print(mAppSerId, (char*)rssiLabels[i], gAllowToBlock_d);
+            Serial_PrintDec(mAppSerId, link.rssiHist[i]);
+        }
+        Serial_Print(mAppSerId, "\r\n", gAllowToBlock_d);
+    }
+}
+
+/*! *********************************************************************************
+* \brief  Starts continuous reception unless the receiver is listening already
+********************************************************************************** */
+static void Genfsk_ListenRx(void)
+{
+    genfskStatus_t status = GENFSK_StartRxContinuous(mAppGenfskId, gaRxBuffers, gRadioRxBufferCount_c,
+                                                     gGenFskDefaultMaxBufferSize_c + crcConfig.crcSize);
+
+    if(gGenfskSuccess_c != status && gGenfskBusyRx_c != status) {
+        GENFSK_AbortAll();
+        Serial_Print(mAppSerId, "\n\rRADIO Rx failed.\r\n\r\n", gAllowToBlock_d);
+    }
+}
+
+/*! *********************************************************************************
+* \brief  Queues a received packet for the console log, dropping it if the log is full
+********************************************************************************** */
+static void Genfsk_LogRx(uint16_t u16PacketIndex, uint8_t address, uint8_t ledState, uint8_t rssi, uint32_t timestamp)
+{
+    uint8_t head = mRxLogHead;
+    radioRxLog_t* pRecord;
+
+    if((uint8_t)(head - mRxLogTail) >= gRadioLogLen_c) {
+        mRxLogDropped++;
+        return;
+    }
+    pRecord = &maRxLog[head & (gRadioLogLen_c - 1)];
+    pRecord->timestamp = timestamp;
+    pRecord->index = u16PacketIndex;
+    pRecord->address = address;
+    pRecord->ledState = ledState;
+    pRecord->rssi = rssi;
+    __DMB(); /*the record is complete before the task can see it*/
+    mRxLogHead = head + 1;
+    OSA_EventSet(mRxLogEvent, gRadioLogRecord_c);
+}
+
+/*! *********************************************************************************
+* \brief  Low priority task that prints the console log, a few records at a time
+********************************************************************************** */
+static void Genfsk_LogTask(osaTaskParam_t argument)
+{
+    osaEventFlags_t flags;
+    radioRxLog_t record;
+    uint32_t u32ReportedDrops = 0;
+    uint8_t burst = 0;
+    int8_t i8TempRssiValue;
+
+    while(1) {
+        (void)OSA_EventWait(mRxLogEvent, gRadioLogRecord_c | gRadioLogLinkStats_c, FALSE, osaWaitForever_c, &flags);
+
+        if(flags & gRadioLogLinkStats_c) {
+            Genfsk_PrintLinkStats();
+        }
+
+        while(mRxLogTail != mRxLogHead) {
+            record = maRxLog[mRxLogTail & (gRadioLogLen_c - 1)];
+            __DMB(); /*copied out before the slot is handed back*/
+            mRxLogTail++;
+
+            i8TempRssiValue = (int8_t)record.rssi;
+            Serial_Print(mAppSerId, "Packet ", gAllowToBlock_d);
+            Serial_PrintDec(mAppSerId, (uint32_t)record.index);
+            Serial_Print(mAppSerId, ". LED State: ",gAllowToBlock_d);
+            Serial_PrintDec(mAppSerId, (uint32_t)record.ledState);
+            Serial_Print(mAppSerId, ". Rssi: ", gAllowToBlock_d);
+            if(i8TempRssiValue < 0) {
+                i8TempRssiValue *= -1;
+                Serial_Print(mAppSerId, "-", gAllowToBlock_d);
+            }
+            Serial_PrintDec(mAppSerId, (uint32_t)i8TempRssiValue);
+            Serial_Print(mAppSerId, ". Timestamp: ", gAllowToBlock_d);
+            Serial_PrintDec(mAppSerId, record.timestamp);
+            Serial_Print(mAppSerId, "\r\n", gAllowToBlock_d);
+
+            if(++burst >= gRadioLogBurst_c) {
+                burst = 0;
+                OSA_TimeDelay(gRadioLogPeriodMs_c);
+            }
+        }
+
+        if(u32ReportedDrops != mRxLogDropped) {
+            u32ReportedDrops = mRxLogDropped;
+            Serial_Print(mAppSerId, "Log records dropped: ", gAllowToBlock_d);
+            Serial_PrintDec(mAppSerId, u32ReportedDrops);
+            Serial_Print(mAppSerId, "\r\n", gAllowToBlock_d);
+        }
+    }
+}
+
+OSA_TASK_DEFINE(Genfsk_LogTask, gRadioLogTaskPriority_c, 1, gRadioLogTaskStackSize_c, FALSE);
+
 /*! *********************************************************************************
 * \brief  Handles the Packet error rate RX test
 ********************************************************************************** */
 bool_t Genfsk_Receive(ct_event_t evType, void* pAssociatedValue)
 {
 	static bool_t initialised = false;
-    static int32_t  i32RssiSum;
     // static uint16_t u16ReceivedPackets;
     static uint8_t ledstate;
     static uint8_t address;
@@ -189,6 +532,7 @@ bool_t Genfsk_Receive(ct_event_t evType, void* pAssociatedValue)
     ct_rx_indication_t* pIndicationInfo = NULL;
     uint8_t* pRxBuffer = NULL;
     bool_t bRestartRx = FALSE;
+    bool_t bAckSent = FALSE;
     bool_t bReturnFromSM = FALSE;
     
     if(!initialised) /* Reset the state machine */
@@ -196,34 +540,46 @@ bool_t Genfsk_Receive(ct_event_t evType, void* pAssociatedValue)
         u16PacketIndex = 0;
         ledstate = 0;
         address = 0;
-        i32RssiSum = 0;
 
         Serial_Print(mAppSerId, "\f\n\rRADIO Rx Running\r\n\r\n", gAllowToBlock_d);
 
-        if(gGenfskSuccess_c != GENFSK_StartRx(mAppGenfskId, gRxBuffer, gGenFskDefaultMaxBufferSize_c + crcConfig.crcSize, 0, 0)) {
-        	GENFSK_AbortAll();
-            Serial_Print(mAppSerId, "\n\rRADIO Rx failed.\r\n\r\n", gAllowToBlock_d);
-        }
+        mRxLogEvent = OSA_EventCreate(TRUE);
+        OSA_TaskCreate(OSA_TASK(Genfsk_LogTask), NULL);
+
+        Genfsk_ListenRx();
 
         initialised = true;
     }
 
-    /*check if RX related events are fired */
-    if(gCtEvtRxDone_c == evType || gCtEvtRxFailed_c == evType || gCtEvtSeqTimeout_c == evType) {
+    /*check if RX related events are fired; TX done ends an ACK we sent*/
+    if(gCtEvtRxDone_c == evType || gCtEvtRxFailed_c == evType || gCtEvtSeqTimeout_c == evType || gCtEvtTxDone_c == evType) {
     	/*if rx successful, get packet information */
     	if (gCtEvtRxDone_c == evType) {
                 pIndicationInfo = (ct_rx_indication_t*)pAssociatedValue;
-                pRxBuffer = pIndicationInfo->pBuffer; /*same as gRxBuffer*/
+                pRxBuffer = pIndicationInfo->pBuffer;
                 
                 /*map rx buffer to generic fsk packet*/
                 GENFSK_ByteArrayToPacket(mAppGenfskId, pRxBuffer, &gRxPacket);
-                if(gRxPacket.payload[4] == gRadioOpcode1 && 
+                if(!pIndicationInfo->crcValid) /* corrupted, nothing in it can be trusted */
+                {
+                    maLinkStats[0].crcFailed++;
+                    bRestartRx = TRUE;
+                }
+                else if(gRxPacket.payload[4] == gRadioOpcode1 && 
+                   gRxPacket.payload[5] == gRadioAckOpcode2 &&
+                   gRxPacket.payload[2] < gRadioMaxNodes_c) /* another node's ACK */
+                {
+                    Genfsk_CountRx(&maLinkStats[gRxPacket.payload[2]],
+                                   ((uint16_t)gRxPacket.payload[0] <<8) + gRxPacket.payload[1], pIndicationInfo->rssi, FALSE);
+                    bRestartRx = TRUE;
+                }
+                else if(gRxPacket.payload[4] == gRadioOpcode1 && 
                    gRxPacket.payload[5] == gRadioOpcode2) /* check if packet payload is RADIO type */
                 {
                     u16PacketIndex = ((uint16_t)gRxPacket.payload[0] <<8) + gRxPacket.payload[1];
                     address = gRxPacket.payload[2];
                     ledstate = gRxPacket.payload[3];
-                    i32RssiSum += (int8_t)(pIndicationInfo->rssi);
+                    Genfsk_CountRx(&maLinkStats[0], u16PacketIndex, pIndicationInfo->rssi, TRUE);
                     
                     if (address == DEVICEADDRESS){
                     	if (ledstate == 1) {
@@ -231,6 +587,21 @@ bool_t Genfsk_Receive(ct_event_t evType, void* pAssociatedValue)
                     	} else {
                     		Led3Off();
                     	}
+#if gRadioAckEnabled_d
+                    	/*acknowledge before printing, the TX node is listening for it.
+                    	  RX restarts on the TX done event of the ACK*/
+                    	uint8_t linkStats[gRadioLinkStatsLen_c];
+
+                    	/*the ACK carries how well we hear the TX node*/
+                    	Genfsk_PackLinkStats(linkStats, &maLinkStats[0]);
+                    	/*the link layer is listening again already, the ACK needs the radio*/
+                    	GENFSK_CancelPendingRx();
+                    	if (gGenfskSuccess_c == GENFSK_StartTx(mAppGenfskId, maAckBuffer,
+                    	        Genfsk_PackFrame(maAckBuffer, u16PacketIndex, address, ledstate, gRadioAckOpcode2,
+                    	                         linkStats, gRadioLinkStatsLen_c), 0)) {
+                    		bAckSent = TRUE;
+                    	}
+#endif
                     }
 /* else if (address == 2){
                     	if (ledstate == 1) {
@@ -247,21 +618,8 @@ bool_t Genfsk_Receive(ct_event_t evType, void* pAssociatedValue)
                     	}
                     }
 */
-                    /* print statistics */
-                    int8_t i8TempRssiValue = (int8_t)(pIndicationInfo->rssi);
-                    Serial_Print(mAppSerId, "Packet ", gAllowToBlock_d);
-                    Serial_PrintDec(mAppSerId,(uint32_t)u16PacketIndex);
-                    Serial_Print(mAppSerId, ". LED State: ",gAllowToBlock_d);
-                    Serial_PrintDec(mAppSerId, (uint32_t)ledstate);
-                    Serial_Print(mAppSerId, ". Rssi: ", gAllowToBlock_d);
-                    if(i8TempRssiValue < 0) {
-                    	i8TempRssiValue *= -1;
-                        Serial_Print(mAppSerId, "-", gAllowToBlock_d);
-                    }
-                    Serial_PrintDec(mAppSerId, (uint32_t)i8TempRssiValue);
-                    Serial_Print(mAppSerId, ". Timestamp: ", gAllowToBlock_d);
-                    Serial_PrintDec(mAppSerId, (uint32_t)pIndicationInfo->timestamp);
-                    Serial_Print(mAppSerId, "\r\n", gAllowToBlock_d);
+                    /* statistics are printed later by the log task, printing here would hold up reception */
+                    Genfsk_LogRx(u16PacketIndex, address, ledstate, pIndicationInfo->rssi, (uint32_t)pIndicationInfo->timestamp);
                     
                     bRestartRx = TRUE;
                 } 
@@ -272,15 +630,17 @@ bool_t Genfsk_Receive(ct_event_t evType, void* pAssociatedValue)
             }
             else
             {
+                if (gCtEvtRxFailed_c == evType && pAssociatedValue != NULL &&
+                    *(genfskEventStatus_t*)pAssociatedValue == gGenfskCRCInvalid)
+                {
+                    maLinkStats[0].crcFailed++;
+                }
                 bRestartRx = TRUE;
             }
 
-    	/*restart RX immediately with no timeout*/
-            if(bRestartRx) {
-                if(gGenfskSuccess_c != GENFSK_StartRx(mAppGenfskId, gRxBuffer, gGenFskDefaultMaxBufferSize_c + crcConfig.crcSize, 0, 0)) {
-                    GENFSK_AbortAll();
-                    Serial_Print(mAppSerId, "\n\rRADIO Rx failed.\r\n\r\n", gAllowToBlock_d);
-                }
+    	/*make sure the receiver is listening, the link layer re-arms it after each packet*/
+            if(bRestartRx && !bAckSent) {
+                Genfsk_ListenRx();
             }  
         }
 
@@ -288,79 +648,254 @@ bool_t Genfsk_Receive(ct_event_t evType, void* pAssociatedValue)
 }
 
 /*! *********************************************************************************
-* \brief  Handles the Packet error rate TX test
+* \brief  Submits the frame at the head of the TX queue to the radio
 ********************************************************************************** */
-bool_t Genfsk_Send(ct_event_t evType, void* pAssociatedValue, uint8_t ledState, uint8_t address)
+static void Genfsk_SubmitTx(void)
 {
-	static bool_t initialised = false;
-    static ct_radio_tx_states_t radioTxState = gRadioTxStateInit_c;
-    static uint32_t miliSecDelay;
+    radioTxEntry_t* pEntry;
+    uint32_t waitUs;
+
+    while(!bTxBusy && mTxCount) {
+        pEntry = &maTxQueue[mTxHead];
+        waitUs = (uint32_t)(GENFSK_GetTimestamp() - pEntry->queued);
+        if(gGenfskSuccess_c == GENFSK_StartTx(mAppGenfskId, pEntry->buffer, pEntry->length, 0)) {
+            bTxBusy = TRUE;
+#if gRadioAckEnabled_d
+            mTxRetries = 0;
+            mTxSentAt = pEntry->queued + waitUs;
+#endif
+            mTxStats.waitSumUs += waitUs;
+            if(waitUs > mTxStats.maxWaitUs) {
+                mTxStats.maxWaitUs = waitUs;
+            }
+        } else {
+            /*drop the frame rather than stall the queue behind it*/
+            mTxStats.failed++;
+            mTxHead = (mTxHead + 1) % gRadioTxQueueLen_c;
+            mTxCount--;
+        }
+    }
+}
+
+/*! *********************************************************************************
+* \brief  Frees the head of the TX queue once it is delivered or given up on
+********************************************************************************** */
+static void Genfsk_ReleaseTx(bool_t bDelivered)
+{
+    bTxBusy = FALSE;
+    if(bDelivered) {
+        mTxStats.sent++;
+    } else {
+        mTxStats.failed++;
+    }
+    mTxHead = (mTxHead + 1) % gRadioTxQueueLen_c;
+    mTxCount--;
+}
+
+#if gRadioAckEnabled_d
+/*! *********************************************************************************
+* \brief  Sends the head of the TX queue again after a backoff, or gives up on it
+********************************************************************************** */
+static void Genfsk_RetryTx(void)
+{
+    radioTxEntry_t* pEntry = &maTxQueue[mTxHead];
+    ct_node_stats_t* pNode = &maNodeStats[pEntry->address % gRadioMaxNodes_c];
+
+    bAckWait = FALSE;
+    if(mTxRetries >= gRadioAckMaxRetries_c) {
+        pNode->lost++;
+        Genfsk_ReleaseTx(FALSE);
+        return;
+    }
+    mTxRetries++;
+    pNode->retries++;
+    /*the backoff doubles with every retry*/
+    mTxSentAt = GENFSK_GetTimestamp() + ((GENFSK_timestamp_t)gRadioAckBackoffUs_c << (mTxRetries - 1));
+    if(gGenfskSuccess_c != GENFSK_StartTx(mAppGenfskId, pEntry->buffer, pEntry->length, mTxSentAt)) {
+        pNode->lost++;
+        Genfsk_ReleaseTx(FALSE);
+    }
+}
+
+/*! *********************************************************************************
+* \brief  Listens for the ACK of the head frame until mAckDeadline
+********************************************************************************** */
+static void Genfsk_AwaitAck(void)
+{
+    GENFSK_timestamp_t now = GENFSK_GetTimestamp();
+
+    bAckWait = TRUE;
+    if(now >= mAckDeadline ||
+       gGenfskSuccess_c != GENFSK_StartRx(mAppGenfskId, gaRxBuffers[0], gGenFskDefaultMaxBufferSize_c + crcConfig.crcSize, 0, mAckDeadline - now)) {
+        Genfsk_RetryTx();
+    }
+}
+#endif
 
+/*! *********************************************************************************
+* \brief  Packs a led command into a pool buffer
+********************************************************************************** */
+static void Genfsk_PackTx(radioTxEntry_t* pEntry, uint16_t u16PacketIndex, uint8_t ledState, uint8_t address)
+{
+    pEntry->length = Genfsk_PackFrame(pEntry->buffer, u16PacketIndex, address, ledState, gRadioOpcode2, NULL, 0);
+    pEntry->index = u16PacketIndex;
+    pEntry->address = address;
+}
+
+/*! *********************************************************************************
+* \brief  Queues a led command for a radio node; it goes out as soon as the radio is free.
+*         Only the last state matters, so a command still waiting for the same node
+*         is overwritten in place instead of queueing another frame.
+********************************************************************************** */
+bool_t Genfsk_Send(uint8_t ledState, uint8_t address)
+{
     static uint16_t u16PacketIndex = 0;
-    
-    uint16_t buffLen = 0;
-    bool_t bReturnFromSM = FALSE;
+    radioTxEntry_t* pEntry;
+    uint8_t i;
+    bool_t bQueued = FALSE;
 
-    if(!initialised) {
-        radioTxState = gRadioTxStateInit_c;
-        miliSecDelay = 10;
-
-        miliSecDelay *= 1000; /*convert into microseconds*/
-
-        u16PacketIndex++;
-
-        gTxPacket.header.lengthField = (uint16_t)gaConfigParams[3].paramValue.decValue;
-
-        gTxPacket.payload[0] = (u16PacketIndex >> 8);
-        gTxPacket.payload[1] = (uint8_t)u16PacketIndex;
-        gTxPacket.payload[2] = address;
-        gTxPacket.payload[3] = ledState;
-        gTxPacket.payload[4] = gRadioOpcode1;
-        gTxPacket.payload[5] = gRadioOpcode2;
-        
-        /*pack everything into a buffer*/
-        GENFSK_PacketToByteArray(mAppGenfskId, &gTxPacket, gTxBuffer);
-        /*calculate buffer length*/
-        buffLen = gTxPacket.header.lengthField+
-                    (gGenFskDefaultHeaderSizeBytes_c)+
-                        (gGenFskDefaultSyncAddrSize_c + 1);
-                
-        /*start tx at current time + input delay*/
-        if(gGenfskSuccess_c != GENFSK_StartTx(mAppGenfskId, gTxBuffer, buffLen, 0)) {
-            GENFSK_AbortAll();
-            Serial_Print(mAppSerId, "\r\n\r\nRadio TX failed.\r\n\r\n", gAllowToBlock_d);
-            radioTxState = gRadioTxStateIdle_c;
+    OSA_InterruptDisable();
+    /*the head is on the air while bTxBusy, so it can't be changed*/
+    for(i = bTxBusy ? 1 : 0; i < mTxCount; i++) {
+        pEntry = &maTxQueue[(mTxHead + i) % gRadioTxQueueLen_c];
+        if(pEntry->address == address) {
+            /*keep the index and queue time: the node never saw the replaced command*/
+            Genfsk_PackTx(pEntry, pEntry->index, ledState, address);
+            mTxStats.coalesced++;
+            bQueued = TRUE;
+            break;
         }
+    }
+    if(!bQueued && mTxCount < gRadioTxQueueLen_c) {
+        pEntry = &maTxQueue[(mTxHead + mTxCount) % gRadioTxQueueLen_c];
+        Genfsk_PackTx(pEntry, ++u16PacketIndex, ledState, address);
+        pEntry->queued = GENFSK_GetTimestamp();
 
-        Serial_Print(mAppSerId, "\f\r\n Running RADIO Tx, Number of packets: ", gAllowToBlock_d);
-        Serial_PrintDec(mAppSerId, (uint32_t)u16PacketIndex);
-        
-        radioTxState = gRadioTxStateRunning_c;
-        initialised = true;
+        mTxCount++;
+        if(mTxCount > mTxStats.maxDepth) {
+            mTxStats.maxDepth = mTxCount;
+        }
+        bQueued = TRUE;
+        Genfsk_SubmitTx();
+    } else if(!bQueued) {
+        mTxStats.dropped++;
     }
+    OSA_InterruptEnable();
 
-     if (radioTxState == gRadioTxStateRunning_c) {
-         if(gCtEvtTxDone_c == evType) {
-                 u16PacketIndex++;
-                 gTxPacket.payload[0] = ((u16PacketIndex) >> 8);
-                 gTxPacket.payload[1] = (uint8_t)(u16PacketIndex);
-                 gTxPacket.payload[2] = address;
-                 gTxPacket.payload[3] = ledState;
-                 /*pack everything into a buffer*/
-                 GENFSK_PacketToByteArray(mAppGenfskId, &gTxPacket, gTxBuffer);
-                 /*calculate buffer length*/
-                 buffLen = gTxPacket.header.lengthField+
-                     (gGenFskDefaultHeaderSizeBytes_c)+
-                         (gGenFskDefaultSyncAddrSize_c + 1);
-                
-                 if(gGenfskSuccess_c != GENFSK_StartTx(mAppGenfskId, gTxBuffer, buffLen, GENFSK_GetTimestamp() + miliSecDelay)) {
-                     GENFSK_AbortAll();
-                     Serial_Print(mAppSerId, "\r\n\r\nRadio TX failed.\r\n\r\n", gAllowToBlock_d);
-                     radioTxState = gRadioTxStateIdle_c;
-                 }
-         }
-     }
-    
-    return bReturnFromSM;      
+    return bQueued;
+}
+
+/*! *********************************************************************************
+* \brief  Handles the end of a radio transmission, dispatched from the TX event loop.
+*         Frees the head of the queue, or starts waiting for its ACK, and starts the
+*         next frame as soon as the radio is free.
+********************************************************************************** */
+void Genfsk_SendDone(genfskEventStatus_t status)
+{
+    OSA_InterruptDisable();
+#if gRadioAckEnabled_d
+    if(bTxBusy && !bAckWait) {
+        if(status == gGenfskSuccess) {
+            mAckDeadline = GENFSK_GetTimestamp() + gRadioAckTimeoutUs_c;
+            Genfsk_AwaitAck();
+        } else {
+            Genfsk_RetryTx();
+        }
+    }
+#else
+    if(bTxBusy) {
+        Genfsk_ReleaseTx(status == gGenfskSuccess);
+    }
+#endif
+    Genfsk_SubmitTx();
+    OSA_InterruptEnable();
 }
 
+/*! *********************************************************************************
+* \brief  Handles the radio RX events of the TX node: the ACK for the head frame,
+*         a timeout or a failed reception
+********************************************************************************** */
+void Genfsk_AckReceive(ct_event_t evType, void* pAssociatedValue)
+{
+#if gRadioAckEnabled_d
+    ct_rx_indication_t* pIndicationInfo;
+    radioTxEntry_t* pEntry;
+    ct_node_stats_t* pNode;
+    uint32_t rttUs;
+
+    OSA_InterruptDisable();
+    if(bAckWait) {
+        pEntry = &maTxQueue[mTxHead];
+        if(gCtEvtRxDone_c == evType) {
+            pIndicationInfo = (ct_rx_indication_t*)pAssociatedValue;
+            GENFSK_ByteArrayToPacket(mAppGenfskId, pIndicationInfo->pBuffer, &gRxPacket);
+            if(pIndicationInfo->crcValid &&
+               gRxPacket.payload[4] == gRadioOpcode1 &&
+               gRxPacket.payload[5] == gRadioAckOpcode2 &&
+               gRxPacket.payload[2] == pEntry->address &&
+               (((uint16_t)gRxPacket.payload[0] << 8) + gRxPacket.payload[1]) == pEntry->index) {
+                pNode = &maNodeStats[pEntry->address % gRadioMaxNodes_c];
+                rttUs = (uint32_t)(pIndicationInfo->timestamp - mTxSentAt);
+                pNode->acked++;
+                pNode->rttLastUs = rttUs;
+                pNode->rttSumUs += rttUs;
+                if(pNode->acked == 1 || rttUs < pNode->rttMinUs) {
+                    pNode->rttMinUs = rttUs;
+                }
+                if(rttUs > pNode->rttMaxUs) {
+                    pNode->rttMaxUs = rttUs;
+                }
+                if(gRxPacket.header.lengthField >= gGenFskMinPayloadLen_c + gRadioLinkStatsLen_c) {
+                    Genfsk_UnpackLinkStats(&gRxPacket.payload[gGenFskMinPayloadLen_c], &pNode->link);
+                }
+                bAckWait = FALSE;
+                Genfsk_ReleaseTx(TRUE);
+            } else {
+                /*someone else's frame: keep listening for the rest of the window*/
+                Genfsk_AwaitAck();
+            }
+        } else {
+            Genfsk_RetryTx();
+        }
+        Genfsk_SubmitTx();
+    }
+    OSA_InterruptEnable();
+#endif
+}
+
+/*! *********************************************************************************
+* \brief  Copies the TX queue counters
+********************************************************************************** */
+void Genfsk_GetTxStats(ct_tx_stats_t* pStats)
+{
+    OSA_InterruptDisable();
+    *pStats = mTxStats;
+    pStats->depth = mTxCount;
+    OSA_InterruptEnable();
+}
+
+/*! *********************************************************************************
+* \brief  Copies the delivery counters and round-trip times of one node
+********************************************************************************** */
+bool_t Genfsk_GetNodeStats(uint8_t address, ct_node_stats_t* pStats)
+{
+#if gRadioAckEnabled_d
+    if(address < gRadioMaxNodes_c) {
+        OSA_InterruptDisable();
+        *pStats = maNodeStats[address];
+        OSA_InterruptEnable();
+        return TRUE;
+    }
+#endif
+    return FALSE;
+}
+
+/*! *********************************************************************************
+* \brief  Asks the log task of an RX node to print the link statistics
+********************************************************************************** */
+void Genfsk_RequestLinkStats(void)
+{
+    if(mRxLogEvent) {
+        OSA_EventSet(mRxLogEvent, gRadioLogLinkStats_c);
+    }
+}
@@ -34,6 +34,7 @@
 #define __GEN_FSK_TESTS_H__
 
 #include "stdint.h"
+#include "genfsk_interface.h"
 
 /*! *********************************************************************************
 *************************************************************************************
@@ -87,6 +88,45 @@ typedef struct ct_rx_indication_tag
     uint8_t crcValid;
 }ct_rx_indication_t;
 
+/*rssi histogram: below -90 dBm, then 10 dB wide buckets up to -50 dBm and above*/
+#define gRadioRssiBuckets_c (6)
+
+typedef struct ct_tx_stats_tag
+{
+    uint16_t depth;
+    uint16_t maxDepth;
+    uint32_t sent;
+    uint32_t failed;
+    uint32_t dropped;
+    uint32_t coalesced;
+    uint32_t waitSumUs;
+    uint32_t maxWaitUs;
+}ct_tx_stats_t;
+
+typedef struct ct_link_stats_tag
+{
+    uint32_t received;
+    uint32_t missed;
+    uint32_t duplicates;
+    uint32_t crcFailed;
+    uint16_t rssiHist[gRadioRssiBuckets_c];
+    uint16_t lastIndex;
+    bool_t seen;
+}ct_link_stats_t;
+
+typedef struct ct_node_stats_tag
+{
+    uint32_t acked;
+    uint32_t retries;
+    uint32_t lost;
+    uint32_t rttLastUs;
+    uint32_t rttMinUs;
+    uint32_t rttMaxUs;
+    uint32_t rttSumUs;
+    /*how the node hears the TX node, relayed in its ACKs*/
+    ct_link_stats_t link;
+}ct_node_stats_t;
+
 typedef void (* pHookAppNotification) ( void );
 typedef void (* pTmrHookNotification) (void*);
 /*! *********************************************************************************
@@ -134,6 +174,19 @@ typedef void (* pTmrHookNotification) (void*);
                                        gGenFskDefaultHeaderSizeBytes_c  + \
                                            gGenFskMaxPayloadLen_c)
 
+/*acknowledged delivery: RX nodes answer every led command addressed to them and
+  the TX node retries until the ACK arrives. Both roles must be built alike*/
+#ifndef gRadioAckEnabled_d
+#define gRadioAckEnabled_d (1)
+#endif
+/*how long the TX node listens for an ACK, in microseconds*/
+#define gRadioAckTimeoutUs_c  (10000)
+/*first retry delay, doubled on every further retry*/
+#define gRadioAckBackoffUs_c  (2000)
+#define gRadioAckMaxRetries_c (3)
+/*nodes tracked in the delivery statistics, by address*/
+#define gRadioMaxNodes_c      (8)
+
 /*H0 and H1 config*/
 #define gGenFskDefaultH0Value_c        (0x0000)
 #define gGenFskDefaultH0Mask_c         ((1 << gGenFskDefaultH0FieldSize_c) - 1)
@@ -157,6 +210,16 @@ extern void GenFskInit(pHookAppNotification pFunc, pTmrHookNotification pTmrFunc
 
 /* Genfsk RX handler */
 extern bool_t Genfsk_Receive(ct_event_t evType, void* pAssociatedValue);
-/* Genfsk TX handler */
-extern bool_t Genfsk_Send(ct_event_t evType, void* pAssociatedValue, uint8_t ledstate, uint8_t address);
+/* Genfsk TX handler: queues a led command for a radio node */
+extern bool_t Genfsk_Send(uint8_t ledstate, uint8_t address);
+/* Genfsk TX done handler */
+extern void Genfsk_SendDone(genfskEventStatus_t status);
+/* Genfsk TX node ACK handler */
+extern void Genfsk_AckReceive(ct_event_t evType, void* pAssociatedValue);
+/* Genfsk TX queue counters */
+extern void Genfsk_GetTxStats(ct_tx_stats_t* pStats);
+/* Genfsk delivery counters and round-trip times of one node */
+extern bool_t Genfsk_GetNodeStats(uint8_t address, ct_node_stats_t* pStats);
+/* Genfsk RX node: print the link statistics on the console */
+extern void Genfsk_RequestLinkStats(void);
 #endif
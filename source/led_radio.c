@@ -41,6 +41,16 @@
 #define mAppIdleHook_c 0
 #endif
 
+/*received frames buffered between the GENFSK callback and the app thread, MUST be a power of two*/
+#ifndef gAppRxQueueLen_c
+#define gAppRxQueueLen_c (4)
+#endif
+#if (gAppRxQueueLen_c & (gAppRxQueueLen_c - 1)) || (gAppRxQueueLen_c > 128)
+#error "gAppRxQueueLen_c must be a power of two no larger than 128"
+#endif
+/*largest frame a ring slot holds: sync address, header, payload and up to 4 crc bytes*/
+#define gAppRxSlotSize_c (gGenFskDefaultMaxBufferSize_c + 4)
+
 
 /************************************************************************************
 * Private definitions
@@ -77,10 +87,18 @@ static uint8_t platformInitialized = 0;
 static osaEventId_t mAppThreadEvt;
 /*pointer to data associated to each event*/
 static void* pEvtAssociatedData = NULL;
-/*structure to store information regarding latest received packet*/
-static ct_rx_indication_t mAppRxLatestPacket;
+/*ring of received packets: the GENFSK callback fills at mAppRxHead and the app thread
+  empties at mAppRxTail, both free running. Each slot has its own copy of the frame*/
+static ct_rx_indication_t maAppRxQueue[gAppRxQueueLen_c];
+static uint8_t maAppRxBuffers[gAppRxQueueLen_c][gAppRxSlotSize_c];
+static volatile uint8_t mAppRxHead = 0;
+static volatile uint8_t mAppRxTail = 0;
+/*frames lost because the ring was full*/
+static volatile uint32_t mAppRxOverruns = 0;
 /*latest generic fsk event status*/
 static genfskEventStatus_t mAppGenfskStatus;
+/*status of the latest failed reception*/
+static genfskEventStatus_t mAppRxFailStatus;
 
 /*extern GENFSK instance id*/
 extern uint8_t mAppGenfskId;
@@ -157,14 +175,13 @@ void main_task(uint32_t param)
     
     osaEventFlags_t mAppThreadEvtFlags = gCtEvtWakeUp_c;
 
+    /*both roles block here between events, leaving the cpu to the radio and ppp tasks*/
     while(1) {
-#ifdef RX
     	if(mAppThreadEvtFlags) {
     		App_HandleEvents(mAppThreadEvtFlags);
     	}
 
     	(void)OSA_EventWait(mAppThreadEvt, gCtEvtEventsAll_c, FALSE, osaWaitForever_c ,&mAppThreadEvtFlags);
-#endif
     }
 }
 
@@ -178,14 +195,43 @@ void App_HandleEvents(osaEventFlags_t flags)
 {
 #ifdef RX
 	if(flags & gCtEvtRxDone_c) {
-		pEvtAssociatedData = &mAppRxLatestPacket;
-		Genfsk_Receive(gCtEvtRxDone_c, pEvtAssociatedData);
+		static uint32_t u32ReportedOverruns = 0;
+
+		while(mAppRxTail != mAppRxHead) {
+			pEvtAssociatedData = &maAppRxQueue[mAppRxTail & (gAppRxQueueLen_c - 1)];
+			Genfsk_Receive(gCtEvtRxDone_c, pEvtAssociatedData);
+			mAppRxTail++;
+		}
+
+		if(u32ReportedOverruns != mAppRxOverruns) {
+			u32ReportedOverruns = mAppRxOverruns;
+			Serial_Print(mAppSerId, "RX queue overruns: ", gAllowToBlock_d);
+			Serial_PrintDec(mAppSerId, u32ReportedOverruns);
+			Serial_Print(mAppSerId, "\r\n", gAllowToBlock_d);
+		}
 	}
 
 	if(flags & gCtEvtRxFailed_c) {
+		pEvtAssociatedData = &mAppRxFailStatus;
 		Genfsk_Receive(gCtEvtRxFailed_c, pEvtAssociatedData);
 	}
 
+	if(flags & gCtEvtUart_c) {
+		uint8_t key;
+		uint16_t count;
+
+		/*any key prints the link statistics*/
+		do {
+			count = 0;
+			Serial_Read(mAppSerId, &key, sizeof(key), &count);
+		} while(count);
+		Genfsk_RequestLinkStats();
+	}
+
+	if(flags & gCtEvtTxDone_c) {
+		Genfsk_Receive(gCtEvtTxDone_c, NULL);
+	}
+
 	if(flags & gCtEvtSeqTimeout_c) {
 		Genfsk_Receive(gCtEvtSeqTimeout_c, NULL);
 	}
@@ -198,6 +244,27 @@ void App_HandleEvents(osaEventFlags_t flags)
 	if(flags & gCtEvtSelfEvent_c) {
 		Genfsk_Receive(gCtEvtSelfEvent_c, NULL);
 	}
+#else
+	/*uart data is consumed by the ppp task, which pppReceiveHandler wakes directly*/
+	if(flags & gCtEvtTxDone_c) {
+		Genfsk_SendDone(mAppGenfskStatus);
+	}
+
+	if(flags & gCtEvtRxDone_c) {
+		while(mAppRxTail != mAppRxHead) {
+			pEvtAssociatedData = &maAppRxQueue[mAppRxTail & (gAppRxQueueLen_c - 1)];
+			Genfsk_AckReceive(gCtEvtRxDone_c, pEvtAssociatedData);
+			mAppRxTail++;
+		}
+	}
+
+	if(flags & gCtEvtRxFailed_c) {
+		Genfsk_AckReceive(gCtEvtRxFailed_c, NULL);
+	}
+
+	if(flags & gCtEvtSeqTimeout_c) {
+		Genfsk_AckReceive(gCtEvtSeqTimeout_c, NULL);
+	}
 #endif
 }
 
@@ -216,11 +283,29 @@ static void App_GenFskReceiveCallback(uint8_t *pBuffer,
                                       uint8_t rssi,
                                       uint8_t crcValid)
 {
-   mAppRxLatestPacket.pBuffer      = pBuffer;
-   mAppRxLatestPacket.bufferLength = bufferLength;
-   mAppRxLatestPacket.timestamp    = timestamp;
-   mAppRxLatestPacket.rssi         = rssi;
-   mAppRxLatestPacket.crcValid     = crcValid;
+   uint8_t head = mAppRxHead;
+   ct_rx_indication_t* pIndication;
+
+   if((uint8_t)(head - mAppRxTail) >= gAppRxQueueLen_c)
+   {
+       mAppRxOverruns++;
+   }
+   else
+   {
+       /*copy the frame out, the radio buffer is reused by the next reception*/
+       if(bufferLength > gAppRxSlotSize_c)
+       {
+           bufferLength = gAppRxSlotSize_c;
+       }
+       pIndication = &maAppRxQueue[head & (gAppRxQueueLen_c - 1)];
+       pIndication->pBuffer      = maAppRxBuffers[head & (gAppRxQueueLen_c - 1)];
+       FLib_MemCpy(pIndication->pBuffer, pBuffer, bufferLength);
+       pIndication->bufferLength = bufferLength;
+       pIndication->timestamp    = timestamp;
+       pIndication->rssi         = rssi;
+       pIndication->crcValid     = crcValid;
+       mAppRxHead = head + 1;
+   }
    
    /*send event to app thread*/
    OSA_EventSet(mAppThreadEvt, gCtEvtRxDone_c);
@@ -251,6 +336,7 @@ static void App_GenFskEventNotificationCallback(genfskEvent_t event,
        }
        else
        {
+           mAppRxFailStatus = eventStatus;
            OSA_EventSet(mAppThreadEvt, gCtEvtRxFailed_c);
        }
    }
@@ -25,6 +25,7 @@
 // http://jsfiddle.net/d26cyuh2/  more complete WebSocket demo in JSFiddle, showing cross-domain access
 
 #include "SerialManager.h"
+#include "fsl_os_abstraction.h"
 #include <stdio.h>
 #include <string.h>
 #include "sha1.h"
@@ -33,50 +34,79 @@
 #include "genfsk.h"
 #include "ppp-webserver.h"
 #include "genfsk_defs.h"
+#include "web-assets.h"
 
 
-const static char rootWebPage[] = "\
-<!DOCTYPE html>\
-<html>\
-<head>\
-<title>Blinky Over Radio</title>\
-<body style=\"font-family: sans-serif; font-size:25px; color:#807070\">\
-<h1>Blinky Over Radio</h1>\
-<form>\
-<input type=\"button\" value=\"Toggle LED1\" onclick=\"window.location.href= \'/a\'\"/>\
-<input type=\"button\" value=\"Toggle LED2\" onclick=\"window.location.href= \'/b\'\"/>\
-<input type=\"button\" value=\"Toggle LED3\" onclick=\"window.location.href= \'/c\'\"/>\
-</form>\
-</body>\
-</html>";
-
 // Serial connection
 uint8_t pc;
 
+// wakes up the ppp task
+osaEventId_t pppEvent;
+#define PPP_EVT_RX (1<<0) // the serial callback queued bytes
+#define PPP_EVT_ONLINE (1<<1) // the ppp task saw the connect string or a frame
+
 // the standard hdlc frame start/end character. It's the tilde character "~"
 #define FRAME_7E (0x7e)
 
+#define TCP_FLAG_ACK (1<<4)
+#define TCP_FLAG_SYN (1<<1)
+#define TCP_FLAG_PSH (1<<3)
+#define TCP_FLAG_RST (1<<2)
+#define TCP_FLAG_FIN (1<<0)
+
 pppType ppp; // our global - definitely not thread safe
 
-/// Initialize the ppp structure and clear the receive buffer
-void pppInitStruct()
+/// Set the LCP options back to the RFC 1661 defaults: full ACCM, no header compression
+void lcpOptionsReset()
 {
-    memset( ppp.rx.buf, 0, RXBUFLEN);
+    ppp.opt.accm=0xffffffff; // escape every control character
+    ppp.opt.pfc=0;
+    ppp.opt.acfc=0;
+    ppp.opt.request=LCP_REQ_ALL; // ask the peer for everything we support
+}
+
+/// Forget all VJ header compression state, the peer has to renegotiate it in IPCP
+void vjReset()
+{
+    memset(&ppp.vj, 0, sizeof(ppp.vj));
+    ppp.vj.request=1; // ask the peer to compress what it sends us
+    ppp.vj.rxToss=1; // like RFC 1144, drop compressed packets until an uncompressed one fills a slot
+}
+
+/// Forget the ppp session: go offline, drop the queued bytes and reset the protocol, hdlc, tcp and vj state.
+/// Runs in the ppp task while the serial callback may still be filling the receive queue, so it only moves tail
+void pppSessionReset()
+{
+    ppp.rx.tail=ppp.rx.head; // only the serial callback may move head
     ppp.online=0;
-    ppp.rx.tail=0;
-    ppp.rx.rtail=0;
-    ppp.rx.head=0;
-    ppp.rx.buflevel=0;
+    ppp.rx.match=0;
     ppp.pkt.len=0;
     ppp.ipData.ident=10000; // easy to recognize in ip packet dumps
     ppp.ledState=0;
-    ppp.hdlc.frameStartIndex=0;
+    ppp.hdlc.escape=0;
+    ppp.hdlc.overrun=0;
     ppp.responseCounter=0;
+    lcpOptionsReset();
+    vjReset();
+    ppp.localIP=0;
+    memset(ppp.conn, 0, sizeof(ppp.conn)); // forget all tcp connections
     ppp.firstFrame=1;
     ppp.ppp = (pppHeaderType *)ppp.pkt.buf; // pointer to ppp header
     ppp.ip = (ipHeaderType *)(ppp.pkt.buf+4); // pointer to IP header
 }
 
+/// Initialize the ppp structure and clear the receive buffer, before the ppp task and the serial callback run
+void pppInitStruct()
+{
+    memset( ppp.rx.buf, 0, RXBUFLEN);
+    ppp.rx.tail=0;
+    ppp.rx.head=0;
+    ppp.rx.drops=0;
+    ppp.rx.maxDepth=0;
+    ppp.tx.fill=0;
+    pppSessionReset();
+}
+
 /// Returns 1 after a connect message, 0 at startup or after a disconnect message
 int connectedPpp()
 {
@@ -89,99 +119,377 @@ void fcsReset()
     ppp.fcs=0xffff;   // crc restart
 }
 
+/// PPP FCS lookup table, one entry per byte value (RFC 1662 polynomial 0x8408, reflected)
+/// Lives in flash and replaces the bit-at-a-time loop, so each byte costs one lookup instead of 8 iterations
+const static unsigned short fcsTable[256] = {
+    0x0000, 0x1189, 0x2312, 0x329b, 0x4624, 0x57ad, 0x6536, 0x74bf,
+    0x8c48, 0x9dc1, 0xaf5a, 0xbed3, 0xca6c, 0xdbe5, 0xe97e, 0xf8f7,
+    0x1081, 0x0108, 0x3393, 0x221a, 0x56a5, 0x472c, 0x75b7, 0x643e,
+    0x9cc9, 0x8d40, 0xbfdb, 0xae52, 0xdaed, 0xcb64, 0xf9ff, 0xe876,
+    0x2102, 0x308b, 0x0210, 0x1399, 0x6726, 0x76af, 0x4434, 0x55bd,
+    0xad4a, 0xbcc3, 0x8e58, 0x9fd1, 0xeb6e, 0xfae7, 0xc87c, 0xd9f5,
+    0x3183, 0x200a, 0x1291, 0x0318, 0x77a7, 0x662e, 0x54b5, 0x453c,
+    0xbdcb, 0xac42, 0x9ed9, 0x8f50, 0xfbef, 0xea66, 0xd8fd, 0xc974,
+    0x4204, 0x538d, 0x6116, 0x709f, 0x0420, 0x15a9, 0x2732, 0x36bb,
+    0xce4c, 0xdfc5, 0xed5e, 0xfcd7, 0x8868, 0x99e1, 0xab7a, 0xbaf3,
+    0x5285, 0x430c, 0x7197, 0x601e, 0x14a1, 0x0528, 0x37b3, 0x263a,
+    0xdecd, 0xcf44, 0xfddf, 0xec56, 0x98e9, 0x8960, 0xbbfb, 0xaa72,
+    0x6306, 0x728f, 0x4014, 0x519d, 0x2522, 0x34ab, 0x0630, 0x17b9,
+    0xef4e, 0xfec7, 0xcc5c, 0xddd5, 0xa96a, 0xb8e3, 0x8a78, 0x9bf1,
+    0x7387, 0x620e, 0x5095, 0x411c, 0x35a3, 0x242a, 0x16b1, 0x0738,
+    0xffcf, 0xee46, 0xdcdd, 0xcd54, 0xb9eb, 0xa862, 0x9af9, 0x8b70,
+    0x8408, 0x9581, 0xa71a, 0xb693, 0xc22c, 0xd3a5, 0xe13e, 0xf0b7,
+    0x0840, 0x19c9, 0x2b52, 0x3adb, 0x4e64, 0x5fed, 0x6d76, 0x7cff,
+    0x9489, 0x8500, 0xb79b, 0xa612, 0xd2ad, 0xc324, 0xf1bf, 0xe036,
+    0x18c1, 0x0948, 0x3bd3, 0x2a5a, 0x5ee5, 0x4f6c, 0x7df7, 0x6c7e,
+    0xa50a, 0xb483, 0x8618, 0x9791, 0xe32e, 0xf2a7, 0xc03c, 0xd1b5,
+    0x2942, 0x38cb, 0x0a50, 0x1bd9, 0x6f66, 0x7eef, 0x4c74, 0x5dfd,
+    0xb58b, 0xa402, 0x9699, 0x8710, 0xf3af, 0xe226, 0xd0bd, 0xc134,
+    0x39c3, 0x284a, 0x1ad1, 0x0b58, 0x7fe7, 0x6e6e, 0x5cf5, 0x4d7c,
+    0xc60c, 0xd785, 0xe51e, 0xf497, 0x8028, 0x91a1, 0xa33a, 0xb2b3,
+    0x4a44, 0x5bcd, 0x6956, 0x78df, 0x0c60, 0x1de9, 0x2f72, 0x3efb,
+    0xd68d, 0xc704, 0xf59f, 0xe416, 0x90a9, 0x8120, 0xb3bb, 0xa232,
+    0x5ac5, 0x4b4c, 0x79d7, 0x685e, 0x1ce1, 0x0d68, 0x3ff3, 0x2e7a,
+    0xe70e, 0xf687, 0xc41c, 0xd595, 0xa12a, 0xb0a3, 0x8238, 0x93b1,
+    0x6b46, 0x7acf, 0x4854, 0x59dd, 0x2d62, 0x3ceb, 0x0e70, 0x1ff9,
+    0xf78f, 0xe606, 0xd49d, 0xc514, 0xb1ab, 0xa022, 0x92b9, 0x8330,
+    0x7bc7, 0x6a4e, 0x58d5, 0x495c, 0x3de3, 0x2c6a, 0x1ef1, 0x0f78
+};
+
 /// update the cumulative PPP FCS (frame check sequence)
 void fcsDo(int x)
 {
-    for (int i=0; i<8; i++) {
-        ppp.fcs=((ppp.fcs&1)^(x&1))?(ppp.fcs>>1)^0x8408:ppp.fcs>>1; // crc calculator
-        x>>=1;
-    }
+    ppp.fcs = (ppp.fcs>>8) ^ fcsTable[ (ppp.fcs^x) & 0xff ]; // crc calculator, one table lookup per byte
 }
 
-/// calculate the PPP FCS (frame check sequence) on an entire block of memory
-int fcsBuf(char * buf, int size) // crc on an entire block of memory
+/// Restart the HDLC decoder at the beginning of a new frame
+void hdlcRxReset()
 {
+    ppp.pkt.len=0;
+    ppp.hdlc.escape=0;
+    ppp.hdlc.overrun=0;
     fcsReset();
-    for(int i=0; i<size; i++)fcsDo(*buf++);
-    return ppp.fcs;
 }
 
-/// Get one character from our received PPP buffer
-int pc_getBuf()
+/// Feed one received character to the streaming HDLC decoder.
+/// 0x7d escapes are removed, the FCS is accumulated and the byte is stored in ppp.pkt.buf in a single pass,
+/// so a frame is handed to determinePacketType() as soon as its closing 0x7e flag arrives.
+void hdlcRxByte(int ch)
 {
-    int x = ppp.rx.buf[ ppp.rx.tail ];
-    ppp.rx.tail=(ppp.rx.tail+1)&(RXBUFLEN-1);
-    ppp.rx.buflevel--;
-    return x;
+    ch &= 0xff;
+    if (ch==FRAME_7E) {
+        if (ppp.firstFrame) {
+            ppp.firstFrame=0; // anything before the very first flag is not a frame
+        } else if ( (ppp.pkt.len>0) && (ppp.hdlc.overrun==0) ) { // skip empty frames (back-to-back flags) and frames that did not fit
+            ppp.pkt.crc = ppp.fcs & 0xffff;
+            if (ppp.pkt.crc == 0xf0b8) { // check for good CRC
+                determinePacketType();
+            }
+        }
+        hdlcRxReset(); // the closing flag of one frame is the opening flag of the next
+        return;
+    }
+    if (ppp.firstFrame) return; // still hunting for the first flag
+    if (ch==0x7d) {
+        ppp.hdlc.escape=1; // the next character is stuffed
+        return;
+    }
+    if (ppp.hdlc.escape) { // unstuff characters prefixed with 0x7d
+        ch ^= 0x20;
+        ppp.hdlc.escape=0;
+    }
+    // expand compressed headers on the fly so everything above us always sees [ff 03 pp pp]
+    if ( (ppp.pkt.len==0) && (ch!=0xff) ) { // address and control field compression: no ff 03 in front
+        ppp.pkt.buf[0]=0xff;
+        ppp.pkt.buf[1]=0x03;
+        ppp.pkt.len=2; // not part of the received frame, so not in the FCS
+    }
+    if ( (ppp.pkt.len==2) && (ch&1) ) { // protocol field compression: an odd first byte is the low byte of the protocol
+        ppp.pkt.buf[2]=0x00;
+        ppp.pkt.len=3;
+    }
+    if (ppp.pkt.len >= PPP_max_size) {
+        ppp.hdlc.overrun=1; // frame too big for our packet buffer - drop it at the closing flag
+        return;
+    }
+    ppp.pkt.buf[ ppp.pkt.len++ ] = ch;
+    fcsDo(ch);
 }
 
-/// Process a received PPP frame
-void processPPPFrame(int start, int end)
+/// do PPP HDLC-like handling of special (flag) characters
+/// control characters are only escaped if their bit is set in accm (the async control character map)
+/// the (possibly escaped) character is stored at out[n], returns the new number of bytes in out
+int hdlcPut(char * out, int n, int ch, unsigned int accm)
 {
-   
-    if(start==end) {
-        return; // empty frame
+    ch &= 0xff;
+    if ( ((ch<0x20) && ((accm>>ch)&1)) || (ch==0x7d) || (ch==0x7e) ) {
+        out[n++] = 0x7d;
+        out[n++] = ch^0x20;  // these characters need special handling
+    } else {
+        out[n++] = ch;
     }
+    return n;
+}
 
-    fcsReset();
-    char * dest = ppp.pkt.buf;
-    ppp.pkt.len=0;
-    int unstuff=0;
-    int idx = start;
-    while(1) {
-        if (unstuff==0) {
-            if (ppp.rx.buf[idx]==0x7d) unstuff=1;
-            else {
-                *dest = ppp.rx.buf[idx];
-                ppp.pkt.len++;
-                dest++;
-                fcsDo(ppp.rx.buf[idx]);
+/// serial driver callback, called when an asynchronous write from a staging buffer has finished
+void pppTxDone(void * param)
+{
+    *(volatile int *)param = 0; // param points to the busy flag of the staging buffer that drained
+}
+
+/// read a big-endian 16-bit field
+unsigned int get16(char * p)
+{
+    return ((p[0]&0xff)<<8) | (p[1]&0xff);
+}
+
+/// read a big-endian 32-bit field
+unsigned int get32(char * p)
+{
+    return (get16(p)<<16) | get16(p+2);
+}
+
+/// write a big-endian 16-bit field
+void put16(char * p, unsigned int x)
+{
+    p[0] = x>>8;
+    p[1] = x;
+}
+
+/// write a big-endian 32-bit field
+void put32(char * p, unsigned int x)
+{
+    put16(p, x>>16);
+    put16(p+2, x);
+}
+
+/// append a VJ delta: one byte for 1..255, otherwise a zero byte followed by the 16-bit value
+char * vjEncode(char * cp, unsigned int n)
+{
+    n &= 0xffff;
+    if ( (n>=256) || (n==0) ) {
+        *cp++ = 0;
+        *cp++ = n>>8;
+        *cp++ = n;
+    } else {
+        *cp++ = n;
+    }
+    return cp;
+}
+
+/// Van Jacobson TCP/IP header compression (RFC 1144) of the packet in ppp.pkt.buf.
+/// Packets that can't be compressed stay TYPE_IP (protocol 0x0021) or go out as an uncompressed-TCP packet (0x002f) that primes a slot.
+/// A compressed packet (0x002d) gets its new header written directly in front of the TCP data, which overwrites the original headers.
+/// Returns how many bytes at the start of ppp.pkt.buf are no longer part of the frame.
+int vjCompress()
+{
+    char * ip = ppp.ipStart;
+    char * tcp = ip+20;
+    if ( (ppp.ip->protocol != 6) || (ppp.ip->headerLength != 5) ) return 0; // only TCP without IP options
+    if ( (ip[6]&0x3f) || ip[7] ) return 0; // fragments stay TYPE_IP
+    int flags = tcp[13];
+    if ( (flags & (TCP_FLAG_SYN|TCP_FLAG_FIN|TCP_FLAG_RST)) || !(flags & TCP_FLAG_ACK) ) return 0; // so do connection setup and teardown
+    int hlen = 20 + 4*((tcp[12]>>4)&0xf); // ip + tcp header
+    if ( (hlen > VJ_MAX_HDR) || (4+hlen+2 > ppp.pkt.len) ) return 0;
+
+    // find the slot of this connection
+    int slot;
+    for (slot=0; slot<ppp.vj.txSlots; slot++) {
+        char * s = ppp.vj.tx[slot].hdr;
+        if ( ppp.vj.tx[slot].len && !memcmp(s+12, ip+12, 8) && !memcmp(s+20, tcp, 4) ) break; // same addresses and ports
+    }
+    if ( slot == ppp.vj.txSlots ) { // a new connection, take over the next slot in turn
+        slot = ppp.vj.txNext;
+        ppp.vj.txNext = (slot+1) % ppp.vj.txSlots;
+        goto uncompressed;
+    }
+    char * old = ppp.vj.tx[slot].hdr;
+    char * otcp = old+20;
+    char deltas[16]; // the encoded changes
+    char * cp = deltas;
+    int changes = 0;
+    unsigned int d;
+
+    // anything that is expected to stay constant must not have changed
+    if ( (ppp.vj.tx[slot].len != hlen) || (old[0] != ip[0]) || (old[1] != ip[1]) || memcmp(old+6, ip+6, 3) ) goto uncompressed;
+    if ( memcmp(old+40, ip+40, hlen-40) ) goto uncompressed; // tcp options changed
+
+    if ( flags & (1<<5) ) { // urgent
+        cp = vjEncode(cp, get16(tcp+18));
+        changes |= VJ_NEW_U;
+    } else if ( get16(tcp+18) != get16(otcp+18) ) goto uncompressed;
+    if ( (d = (get16(tcp+14) - get16(otcp+14)) & 0xffff) ) { // window
+        cp = vjEncode(cp, d);
+        changes |= VJ_NEW_W;
+    }
+    if ( (d = get32(tcp+8) - get32(otcp+8)) ) { // ack
+        if ( d > 0xffff ) goto uncompressed;
+        cp = vjEncode(cp, d);
+        changes |= VJ_NEW_A;
+    }
+    unsigned int ds = get32(tcp+4) - get32(otcp+4);
+    if ( ds ) { // sequence
+        if ( ds > 0xffff ) goto uncompressed;
+        cp = vjEncode(cp, ds);
+        changes |= VJ_NEW_S;
+    }
+    unsigned int oldData = get16(old+2) - hlen; // payload size of the previous packet
+    switch ( changes ) {
+        case 0: // nothing changed, only worth compressing if this one carries data and the previous one was a bare ack
+            if ( (get16(ip+2) != get16(old+2)) && (oldData == 0) ) break;
+            goto uncompressed;
+        case VJ_SPECIAL_I:
+        case VJ_SPECIAL_D: // these combinations are reserved for the special cases below
+            goto uncompressed;
+        case VJ_NEW_S | VJ_NEW_A:
+            if ( (ds == d) && (ds == oldData) ) { // typical terminal traffic
+                changes = VJ_SPECIAL_I;
+                cp = deltas;
             }
-        } else { // unstuff characters prefixed with 0x7d
-            *dest = ppp.rx.buf[idx]^0x20;
-            ppp.pkt.len++;
-            dest++;
-            fcsDo(ppp.rx.buf[idx]^0x20);
-            unstuff=0;
-        }
-        idx = (idx+1) & (RXBUFLEN-1);
-        if (idx == end) break;
+            break;
+        case VJ_NEW_S:
+            if ( ds == oldData ) { // typical data stream
+                changes = VJ_SPECIAL_D;
+                cp = deltas;
+            }
+            break;
     }
-    ppp.pkt.crc = ppp.fcs & 0xffff;
-    if (ppp.pkt.crc == 0xf0b8) { // check for good CRC
-        determinePacketType();
+    if ( (d = (get16(ip+4) - get16(old+4)) & 0xffff) != 1 ) { // ip ident
+        cp = vjEncode(cp, d);
+        changes |= VJ_NEW_I;
     }
+    if ( flags & TCP_FLAG_PSH ) changes |= VJ_PUSH;
+    memcpy(old, ip, hlen); // this header is the reference for the next packet
+
+    int n = cp - deltas;
+    int newSlot = !ppp.vj.txCompSlot || (ppp.vj.txLast != slot);
+    int clen = 1 + newSlot + 2 + n; // changes, slot id, tcp checksum, deltas
+    char * out = ip + hlen - clen; // the compressed header ends where the tcp data starts
+    char chk[2] = { tcp[16], tcp[17] };
+    out[-4] = 0xff; // ppp header in front of it
+    out[-3] = 0x03;
+    out[-2] = 0x00;
+    out[-1] = 0x2d;
+    *out++ = changes | (newSlot ? VJ_NEW_C : 0);
+    if ( newSlot ) *out++ = slot;
+    *out++ = chk[0];
+    *out++ = chk[1];
+    memcpy(out, deltas, n);
+    ppp.vj.txLast = slot;
+    ppp.vj.saved += hlen - clen;
+    return hlen - clen; // the new ppp header starts this far into ppp.pkt.buf
+
+uncompressed: // send the full header, with the slot id in the ip protocol field
+    memcpy(ppp.vj.tx[slot].hdr, ip, hlen);
+    ppp.vj.tx[slot].len = hlen;
+    ppp.vj.txLast = slot;
+    ip[9] = slot;
+    ppp.ppp->protocolR = __REV16( 0x002f );
+    return 0;
 }
 
-/// output a character to the PPP port while checking for incoming characters
-void pcPutcWhileCheckingInput(uint8_t ch)
+/// escape a piece of a frame into out and run it through the fcs.
+/// out is sent and restarted whenever it holds more than room characters
+int hdlcPutPiece(char * out, int n, int room, const char * p, int len, unsigned int accm)
 {
-    Serial_SyncWrite(pc, &ch, 1);
+    unsigned int fcs = ppp.fcs; // keep the running crc in a register instead of the ppp struct
+    for(int i=0; i<len; i++) {
+        if (n > room) {
+            Serial_SyncWrite(pc, (uint8_t *)out, n);
+            n=0;
+        }
+        fcs = (fcs>>8) ^ fcsTable[ (fcs^p[i]) & 0xff ];
+        n = hdlcPut(out, n, p[i], accm);
+    }
+    ppp.fcs = fcs;
+    return n;
 }
 
-/// do PPP HDLC-like handling of special (flag) characters
-void hdlcPut(int ch)
+/// send a PPP frame in HDLC format, gathered from the headers in ppp.pkt.buf and the pieces in seg.
+/// The pieces can be anywhere, flash included, so a response body is never copied: the escaping and the fcs
+/// are done in one pass straight from where the bytes are. ppp.pkt.len is the size of the whole frame, pieces and fcs included.
+/// The frame is escaped into one of two staging buffers and handed to the serial driver in one asynchronous write,
+/// so the next frame can be built while the previous one is still draining.
+void sendPppFrameSegments(const txSegType * seg, int count)
 {
-    if ( (ch<0x20) || (ch==0x7d) || (ch==0x7e) ) {
-        pcPutcWhileCheckingInput(0x7d);
-        pcPutcWhileCheckingInput(ch^0x20);  // these characters need special handling
+    ppp.responseCounter++; // count the number of ppp frames we send
+
+    // VJ compression rewrites the headers in place, keep a copy so callers get their packet back unchanged
+    char hdrSave[4+VJ_MAX_HDR];
+    int saveLen = 0;
+    int skip = 0;
+    int pieces = 0; // bytes in seg
+    for (int i=0; i<count; i++) pieces += seg[i].len;
+    if ( ppp.vj.txSlots && (ppp.ppp->protocolR == __REV16(0x0021)) ) {
+        saveLen = ppp.pkt.len-pieces < (int)sizeof(hdrSave) ? ppp.pkt.len-pieces : (int)sizeof(hdrSave);
+        memcpy(hdrSave, ppp.pkt.buf, saveLen);
+        skip = vjCompress();
+    }
+
+    // apply the negotiated header compression. LCP frames always go out uncompressed with the default ACCM
+    char * frame = ppp.pkt.buf+skip; // first byte we send, moves forward when header fields are left out
+    int len = ppp.pkt.len-skip-pieces-2; // bytes we send from ppp.pkt.buf
+    unsigned int accm = 0xffffffff;
+    char * pfc = 0;
+    if ( get16(frame+2) != 0xc021 ) {
+        accm = ppp.opt.accm;
+        if ( ppp.opt.pfc && (frame[2]==0) ) { // one-byte protocol field: slide ff 03 over the leading zero
+            frame[2]=frame[1];
+            frame[1]=frame[0];
+            pfc=frame; // where the header has to be repaired
+            frame++;
+            len--;
+        }
+        if ( ppp.opt.acfc ) { // leave out the ff 03 address and control bytes
+            frame+=2;
+            len-=2;
+        }
+    }
+
+    int b = ppp.tx.fill; // staging buffer for this frame
+    // if both staging buffers are still queued in the serial driver the link is saturated anyway.
+    // then we send this frame synchronously in small chunks, the serial driver keeps it in order behind the queued ones
+    int sync = ppp.tx.busy[b];
+    char chunk[64];
+    char * out = sync ? chunk : ppp.tx.buf[b];
+    int room = sync ? (int)sizeof(chunk)-3 : PPP_TX_BUFLEN; // chunks keep room for an escaped character and the end flag
+    int n=0;
+    out[n++] = 0x7e; // hdlc start-of-frame "flag"
+    ppp.fcs = 0xffff;
+    n = hdlcPutPiece(out, n, room, frame, len, accm);
+    for (int i=0; i<count; i++) {
+        n = hdlcPutPiece(out, n, room, seg[i].data, seg[i].len, accm);
+    }
+    int crc = ppp.fcs;
+    char fcs[2] = { ~crc>>0, ~crc>>8 }; // fcs lo, fcs hi
+    n = hdlcPutPiece(out, n, room, fcs, 2, accm);
+    out[n++] = 0x7e; // hdlc end-of-frame "flag"
+
+    if (sync) {
+        Serial_SyncWrite(pc, (uint8_t *)out, n);
     } else {
-        pcPutcWhileCheckingInput(ch);
+        ppp.tx.busy[b] = 1;
+        if (Serial_AsyncWrite(pc, (uint8_t *)out, n, pppTxDone, (void *)&ppp.tx.busy[b]) != gSerial_Success_c) {
+            ppp.tx.busy[b] = 0;
+            Serial_SyncWrite(pc, (uint8_t *)out, n); // serial driver queue is full, send it the slow way
+        } else {
+            ppp.tx.fill = b^1; // build the next frame in the other buffer
+        }
+    }
+
+    if (pfc) { // put the full header back, callers often modify and resend the packet
+        pfc[1]=0x03;
+        pfc[2]=0x00;
+    }
+    if (saveLen) {
+        memcpy(ppp.pkt.buf, hdrSave, saveLen);
     }
 }
 
-/// send a PPP frame in HDLC format
+/// send the PPP frame in ppp.pkt.buf in HDLC format
 void sendPppFrame()
 {
-    ppp.responseCounter++; // count the number of ppp frames we send
-    int crc = fcsBuf(ppp.pkt.buf, ppp.pkt.len-2); // update crc
-    ppp.pkt.buf[ ppp.pkt.len-2 ] = (~crc>>0); // fcs lo (crc)
-    ppp.pkt.buf[ ppp.pkt.len-1 ] = (~crc>>8); // fcs hi (crc)
-    pcPutcWhileCheckingInput(0x7e); // hdlc start-of-frame "flag"
-    for(int i=0; i<ppp.pkt.len; i++) {
-        hdlcPut( ppp.pkt.buf[i] ); // send a character
-    }
-    pcPutcWhileCheckingInput(0x7e); // hdlc end-of-frame "flag"
+    sendPppFrameSegments(NULL, 0);
 }
 
 /// convert a network ip address in the buffer to an integer (IP adresses are big-endian, i.e most significant byte first)
@@ -198,30 +506,81 @@ unsigned int ip( int a, int b, int c, int d)
     return a<<24 | b<<16 | c<<8 | d;
 }
 
+/// send our IPCP configuration request: VJ compression while we still want it, and the IP address the peer suggested, if any.
+/// The shortest possible request has no options (4 ppp + 4 ipcp + 2 crc)
+void ipcpSendRequest()
+{
+    char * opt = ppp.ipcp->request;
+    int n=0;
+    if (ppp.vj.request) {
+        opt[n++]=IPCP_OPT_VJ;
+        opt[n++]=6;
+        opt[n++]=0x00; // protocol 0x002d
+        opt[n++]=0x2d;
+        opt[n++]=VJ_SLOTS-1; // max slot id
+        opt[n++]=1; // the slot id may be left out
+    }
+    if (ppp.localIP) {
+        opt[n++]=IPCP_OPT_IP;
+        opt[n++]=6;
+        put32(opt+n, ppp.localIP);
+        n+=4;
+    }
+    ppp.ipcp->code=1; // change code to request
+    ppp.ipcp->lengthR = __REV16( 4+n );
+    ppp.pkt.len=4+4+n+2;
+    sendPppFrame(); // send our request
+}
+
 /// handle IPCP configuration requests
 void ipcpConfigRequestHandler()
 {
-    if(ppp.ipcp->request[0]==3) {
-        ppp.hostIP = bufferToIP(ppp.pkt.buf+10);
+    int len = __REV16( ppp.ipcp->lengthR ) - 4; // size of the option list
+    char * opt = ppp.ipcp->request;
+    ppp.vj.txSlots=0; // no VJ compression towards the peer unless it asks for it again
+    for (int i=0; i+2 <= len; ) {
+        int optLen = opt[i+1] & 0xff;
+        if ( optLen < 2 ) break;
+        if ( (opt[i]==IPCP_OPT_IP) && (optLen==6) ) {
+            ppp.hostIP = bufferToIP(opt+i+2);
+        }
+        if ( (opt[i]==IPCP_OPT_VJ) && (optLen==6) && (get16(opt+i+2)==0x002d) ) {
+            int slots = (opt[i+4]&0xff) + 1;
+            ppp.vj.txSlots = slots < VJ_SLOTS ? slots : VJ_SLOTS; // we may use fewer slots than the peer offers
+            ppp.vj.txCompSlot = opt[i+5];
+            ppp.vj.txNext = 0;
+            ppp.vj.txLast = -1;
+            memset(ppp.vj.tx, 0, sizeof(ppp.vj.tx));
+        }
+        i += optLen;
     }
 
     ppp.ipcp->code=2; // change code to ack
-    sendPppFrame(); // acknowledge everything they ask for - assume it's IP addresses
+    sendPppFrame(); // acknowledge everything they ask for
 
-    ppp.ipcp->code=1; // change code to request
-    ppp.ipcp->lengthR = __REV16( 4 ); // 4 is minimum length - no options in this request
-    ppp.pkt.len=4+4+2; // no options in this request shortest ipcp packet possible (4 ppp + 4 ipcp + 2 crc)
-    sendPppFrame(); // send our request
+    ipcpSendRequest();
 }
 
-/// Handle IPCP NACK by sending our suggested IP address if there is an IP involved.
+/// Handle IPCP NACK by requesting the suggested IP address if there is an IP involved.
 /// This is how Linux responds to an IPCP request with no options - Windows assumes any IP address on the submnet is OK.
-void ipcpNackHandler()
+/// A NACK or reject of VJ compression means we stop asking for it.
+void ipcpNackRejectHandler()
 {
-    if (ppp.ipcp->request[0]==3) { // check if the NACK contains an IP address parameter
-        ppp.ipcp->code=1; // assume the NACK contains our "suggested" IP address
-        sendPppFrame(); // let's request this IP address as ours
+    int reject = (ppp.ipcp->code == 4);
+    int len = __REV16( ppp.ipcp->lengthR ) - 4; // size of the option list
+    char * opt = ppp.ipcp->request;
+    for (int i=0; i+2 <= len; ) {
+        int optLen = opt[i+1] & 0xff;
+        if ( optLen < 2 ) break;
+        if ( (opt[i]==IPCP_OPT_IP) && (optLen==6) ) {
+            ppp.localIP = reject ? 0 : bufferToIP(opt+i+2); // our "suggested" IP address
+        }
+        if ( opt[i]==IPCP_OPT_VJ ) {
+            ppp.vj.request = 0;
+        }
+        i += optLen;
     }
+    ipcpSendRequest(); // let's request this IP address as ours
 }
 
 /// process an incoming IPCP packet
@@ -233,37 +592,104 @@ void IPCPframe()
             ipcpConfigRequestHandler();
             break;
         case 3:
-            ipcpNackHandler();
+        case 4:
+            ipcpNackRejectHandler();
             break;
         default:
             break;
     }
 }
 
-/// perform a 16-bit checksum. if the byte count is odd, stuff in an extra zero byte.
-unsigned int dataCheckSum(char * ptr, int len, int restart)
+/// ones' complement sum (not inverted, folded to 16 bits) of len bytes, read only so it works on const and flash data.
+/// Sums aligned 32-bit words into a 32-bit accumulator and folds the carries once at the end. The words are summed
+/// in the cpu's little-endian order, which only swaps the bytes of the result (RFC 1071), so it is swapped back at the end.
+/// A buffer starting at an odd address is shifted by one byte, which swaps the bytes once more.
+unsigned int onesSum(const char * ptr, int len)
 {
-    unsigned int i,hi,lo;
-    unsigned char placeHolder;
-    if (restart) ppp.sum=0;
-    if (len&1) {
-        placeHolder = ptr[len];
-        ptr[len]=0;  // if the byte count is odd, insert one extra zero byte is after the last real byte because we sum byte PAIRS
+    const unsigned char * p = (const unsigned char *)ptr;
+    unsigned int sum = 0;
+    unsigned int first = 0;
+    int odd = (uintptr_t)p & 1;
+    if ( odd && (len > 0) ) { // the first byte is the high byte of the first big-endian pair
+        first = *p++ << 8;
+        len--;
     }
-    i=0;
-    while ( i<len ) {
-        hi = ptr[i++];
-        lo = ptr[i++];
-        ppp.sum = ppp.sum + ((hi<<8)|lo);
+    if ( ((uintptr_t)p & 2) && (len >= 2) ) { // get to a word boundary
+        sum += *(const uint16_t *)p;
+        p += 2;
+        len -= 2;
     }
-    if (len&1) {
-        ptr[len] = placeHolder;    // restore the extra byte we made zero
+    while (len >= 16) { // the cortex-m0+ can't do unaligned loads, these are all aligned
+        const uint32_t * w = (const uint32_t *)p;
+        sum += (w[0] & 0xffff) + (w[0] >> 16) + (w[1] & 0xffff) + (w[1] >> 16);
+        sum += (w[2] & 0xffff) + (w[2] >> 16) + (w[3] & 0xffff) + (w[3] >> 16);
+        p += 16;
+        len -= 16;
     }
+    while (len >= 4) {
+        uint32_t w = *(const uint32_t *)p;
+        sum += (w & 0xffff) + (w >> 16);
+        p += 4;
+        len -= 4;
+    }
+    if (len >= 2) {
+        sum += *(const uint16_t *)p;
+        p += 2;
+        len -= 2;
+    }
+    if (len) sum += *p; // an odd last byte is paired with a zero
+    sum = (sum & 0xffff) + (sum>>16);
+    sum = (sum & 0xffff) + (sum>>16); // sum one more time to catch any carry from the carry
+    if ( !odd ) sum = ((sum<<8) | (sum>>8)) & 0xffff; // back to big-endian order
+    sum += first;
+    sum = (sum & 0xffff) + (sum>>16);
+    return sum;
+}
+
+/// perform a 16-bit checksum, continuing the one in ppp.sum unless restart is set. Returns the inverted checksum.
+/// the buffer is only read, an odd byte count is summed as if an extra zero byte followed
+unsigned int dataCheckSum(char * ptr, int len, int restart)
+{
+    if (restart) ppp.sum=0;
+    ppp.sum = ppp.sum + onesSum(ptr, len);
     ppp.sum = (ppp.sum & 0xffff) + (ppp.sum>>16);
-    ppp.sum = (ppp.sum & 0xffff) + (ppp.sum>>16); // sum one more time to catch any carry from the carry
     return ~ppp.sum;
 }
 
+/// RFC 1624 incremental checksum update: the new checksum after one 16-bit word of the checksummed data changed from oldWord to newWord.
+/// HC' = ~(~HC + ~m + m'), which costs a few additions instead of a pass over the data
+unsigned int checkSumAdjust(unsigned int checkSum, unsigned int oldWord, unsigned int newWord)
+{
+    unsigned int sum = (~checkSum & 0xffff) + (~oldWord & 0xffff) + (newWord & 0xffff);
+    sum = (sum & 0xffff) + (sum>>16);
+    sum = (sum & 0xffff) + (sum>>16); // sum one more time to catch any carry from the carry
+    return ~sum & 0xffff;
+}
+
+/// add the ones' complement sum of a piece to the sum of the bytes before it.
+/// a piece that starts at an odd offset has all its byte pairs shifted by one, which swaps the bytes of its sum
+unsigned int onesSumAdd(unsigned int sum, int offset, unsigned int piece)
+{
+    if (offset&1) piece = ((piece<<8) | (piece>>8)) & 0xffff;
+    sum += piece;
+    return (sum & 0xffff) + (sum>>16);
+}
+
+/// ones' complement sum of len bytes at offset from into a body, using its precomputed sums of WEB_SUM_BLOCK byte blocks where it can
+unsigned int bodySum(const char * body, const unsigned short * blockSum, int from, int len)
+{
+    if (blockSum == NULL) return onesSum(body+from, len);
+    int head = (WEB_SUM_BLOCK - from%WEB_SUM_BLOCK) % WEB_SUM_BLOCK; // bytes up to the first whole block
+    if (head > len) head = len;
+    unsigned int sum = onesSum(body+from, head);
+    int done = head;
+    while (len - done >= WEB_SUM_BLOCK) {
+        sum = onesSumAdd(sum, done, blockSum[(from+done)/WEB_SUM_BLOCK]);
+        done += WEB_SUM_BLOCK;
+    }
+    return onesSumAdd(sum, done, onesSum(body+from+done, len-done));
+}
+
 /// perform the checksum on an IP header
 void IpHeaderCheckSum()
 {
@@ -343,7 +769,7 @@ void sendUdp(unsigned int srcIp, unsigned int dstIp, unsigned int srcPort, unsig
     initIP(srcIp, dstIp, srcPort, dstPort, 17); // init a UDP packet
     ppp.ip->lengthR = __REV16(len.ipAll); // update IP length in buffer
     ppp.udpStart = ppp.ipStart + len.ipHeader; // calculate start of udp header
-    memcpy( ppp.udp->data, message, len.udpData ); // copy the message to the buffer
+    memmove( ppp.udp->data, message, len.udpData ); // copy the message to the buffer, it may overlap like the test reply does
     ppp.udp->lengthR = __REV16(len.udpAll); // update UDP length in buffer
     ppp.pkt.len = len.ipAll+2+4; // update ppp packet length
     IpHeaderCheckSum();  // refresh IP header checksum
@@ -354,6 +780,215 @@ void sendUdp(unsigned int srcIp, unsigned int dstIp, unsigned int srcPort, unsig
     sendPppFrame(); // send the UDP message back
 }
 
+/// toggle one of the leds: ours and the one on the radio node with the same number.
+/// all websocket clients and coap observers get the new state
+void ledToggle(int led)
+{
+    ppp.ledState ^= 1<<led;
+    Genfsk_Send((ppp.ledState>>led)&1, led+1); // queued, goes out when the radio is free
+    if (led == 0) Led2Toggle();
+    if (led == 1) Led3Toggle();
+    if (led == 2) Led4Toggle();
+    for (int i=0; i<TCP_CONNECTIONS; i++) {
+        if ( ppp.conn[i].state && ppp.conn[i].ws ) ppp.conn[i].wsPending |= 1<<led; // sent by wsFlush when the connection is idle
+    }
+    ppp.coap.seq++;
+    for (int i=0; i<COAP_OBSERVERS; i++) {
+        if ( ppp.coap.obs[i].used && (ppp.coap.obs[i].led == led) ) ppp.coap.obs[i].pending = 1; // sent by coapNotify
+    }
+}
+
+/// build a coap message (RFC 7252) in msg with the options we use, returns its byte size.
+/// observe < 0 leaves out the observe option, format < 0 the content format
+int coapMessage(char * msg, int type, int code, unsigned int mid, char * token, int tkl, int observe, int format, const char * payload, int len)
+{
+    int n = 0;
+    int last = 0; // options are delta encoded
+    msg[n++] = 0x40 | (type << 4) | tkl; // version 1
+    msg[n++] = code;
+    put16(msg+n, mid);
+    n += 2;
+    memcpy(msg+n, token, tkl);
+    n += tkl;
+    if (observe >= 0) {
+        int bytes = observe > 0xffff ? 3 : observe > 0xff ? 2 : observe > 0 ? 1 : 0;
+        msg[n++] = ((COAP_OPT_OBSERVE - last) << 4) | bytes;
+        for (int i=bytes-1; i>=0; i--) msg[n++] = observe >> (8*i);
+        last = COAP_OPT_OBSERVE;
+    }
+    if (format >= 0) {
+        int bytes = format ? 1 : 0;
+        msg[n++] = ((COAP_OPT_FORMAT - last) << 4) | bytes;
+        if (bytes) msg[n++] = format;
+    }
+    if (len) {
+        msg[n++] = 0xff; // payload marker
+        memcpy(msg+n, payload, len);
+        n += len;
+    }
+    return n;
+}
+
+/// send pending notifications to the coap observers, as non-confirmable messages
+void coapNotify()
+{
+    char msg[32];
+    for (int i=0; i<COAP_OBSERVERS; i++) {
+        if ( !ppp.coap.obs[i].used || !ppp.coap.obs[i].pending ) continue;
+        ppp.coap.obs[i].pending = 0;
+        ppp.coap.obs[i].mid = ppp.coap.mid++;
+        char state = '0' + ((ppp.ledState >> ppp.coap.obs[i].led) & 1);
+        int n = coapMessage(msg, COAP_NON, COAP_CONTENT, ppp.coap.obs[i].mid, ppp.coap.obs[i].token, ppp.coap.obs[i].tkl, ppp.coap.seq & 0xffffff, COAP_FORMAT_TEXT, &state, 1);
+        sendUdp(ppp.coap.obs[i].localIp, ppp.coap.obs[i].ip, ppp.coap.obs[i].localPort, ppp.coap.obs[i].port, msg, n);
+    }
+}
+
+/// register (observe 0) or deregister (anything else) the sender of the current coap request as an observer of led.
+/// returns 1 if it is registered
+int coapObserve(int led, char * token, int tkl, int observe)
+{
+    unsigned int ip = __REV( ppp.ip->srcAdrR );
+    unsigned int port = __REV16( ppp.udp->srcPortR ) & 0xffff;
+    int slot = -1;
+    for (int i=0; i<COAP_OBSERVERS; i++) { // the same client and token replace their registration
+        if ( ppp.coap.obs[i].used && (ppp.coap.obs[i].ip == ip) && (ppp.coap.obs[i].port == port) && (ppp.coap.obs[i].tkl == tkl) && !memcmp(ppp.coap.obs[i].token, token, tkl) ) {
+            ppp.coap.obs[i].used = 0;
+            slot = i;
+        }
+    }
+    if (observe != 0) return 0;
+    for (int i=0; (slot < 0) && (i<COAP_OBSERVERS); i++) {
+        if ( !ppp.coap.obs[i].used ) slot = i;
+    }
+    if (slot < 0) return 0; // table full, the client just gets this one response
+    ppp.coap.obs[slot].used = 1;
+    ppp.coap.obs[slot].led = led;
+    ppp.coap.obs[slot].ip = ip;
+    ppp.coap.obs[slot].port = port;
+    ppp.coap.obs[slot].localIp = __REV( ppp.ip->dstAdrR );
+    ppp.coap.obs[slot].localPort = __REV16( ppp.udp->dstPortR ) & 0xffff;
+    ppp.coap.obs[slot].tkl = tkl;
+    memcpy(ppp.coap.obs[slot].token, token, tkl);
+    ppp.coap.obs[slot].pending = 0;
+    return 1;
+}
+
+/// handle a coap request on udp port 5683.
+/// the leds are the resources led/1, led/2 and led/3: GET returns "0" or "1" and can be observed, PUT sets them.
+/// .well-known/core lists them
+void coapHandler(char * data, int len)
+{
+    const static char core[] = "</led/1>;obs,</led/2>;obs,</led/3>;obs";
+    char path[32];
+    char msg[80];
+    int pathLen = 0;
+    int observe = -1;
+    int badOption = 0;
+    if ( (len < 4) || ((data[0] & 0xc0) != 0x40) ) return; // not coap version 1
+    int type = (data[0] >> 4) & 3;
+    int tkl = data[0] & 0x0f;
+    int code = data[1] & 0xff;
+    unsigned int mid = get16(data+2);
+    char * token = data+4;
+    if ( (tkl > 8) || (4+tkl > len) ) return; // message format error
+    if ( type == COAP_RST ) { // the client forgot an observation
+        for (int i=0; i<COAP_OBSERVERS; i++) {
+            if ( ppp.coap.obs[i].used && (ppp.coap.obs[i].mid == mid) ) ppp.coap.obs[i].used = 0;
+        }
+        return;
+    }
+    if ( type == COAP_ACK ) return;
+
+    // parse the options
+    int i = 4 + tkl;
+    int number = 0;
+    while ( (i < len) && ((data[i] & 0xff) != 0xff) ) {
+        int delta = (data[i] >> 4) & 0x0f;
+        int optLen = data[i] & 0x0f;
+        i++;
+        int extended = (delta == 13 ? 1 : delta == 14 ? 2 : 0) + (optLen == 13 ? 1 : optLen == 14 ? 2 : 0);
+        if ( i + extended > len ) return; // message format error, the extended delta or length is cut off
+        if (delta == 13) delta = 13 + (data[i++] & 0xff);
+        else if (delta == 14) { delta = 269 + get16(data+i); i += 2; }
+        if (optLen == 13) optLen = 13 + (data[i++] & 0xff);
+        else if (optLen == 14) { optLen = 269 + get16(data+i); i += 2; }
+        if ( (delta == 15) || (optLen == 15) || (i + optLen > len) ) return; // message format error
+        number += delta;
+        if (number == COAP_OPT_URI_PATH) {
+            if (pathLen + optLen + 1 >= (int)sizeof(path)) badOption = 1;
+            else {
+                if (pathLen) path[pathLen++] = '/';
+                memcpy(path+pathLen, data+i, optLen);
+                pathLen += optLen;
+            }
+        } else if (number == COAP_OPT_OBSERVE) {
+            observe = 0;
+            for (int j=0; j<optLen; j++) observe = (observe << 8) | (data[i+j] & 0xff);
+        } else if ( (number & 1) && (number != 3) && (number != 7) && (number != 17) ) {
+            badOption = 1; // an unknown critical option, we can't ignore it
+        }
+        i += optLen;
+    }
+    char * payload = data + i + 1; // after the payload marker
+    int payloadLen = (i < len) ? len - i - 1 : 0;
+    path[pathLen] = 0;
+
+    if ( code == 0 ) { // empty message, a coap ping
+        if (type == COAP_CON) {
+            int n = coapMessage(msg, COAP_RST, 0, mid, token, 0, -1, -1, NULL, 0);
+            sendUdp(__REV(ppp.ip->dstAdrR), __REV(ppp.ip->srcAdrR), __REV16(ppp.udp->dstPortR), __REV16(ppp.udp->srcPortR), msg, n);
+        }
+        return;
+    }
+    if ( (code >> 5) != 0 ) return; // only requests are for us
+
+    // a confirmable request gets a piggybacked ack, a non-confirmable one a response of its own
+    int rType = (type == COAP_CON) ? COAP_ACK : COAP_NON;
+    unsigned int rMid = (type == COAP_CON) ? mid : ppp.coap.mid++;
+    int rCode = COAP_NOT_FOUND;
+    int rObserve = -1, rFormat = -1;
+    const char * rPayload = NULL;
+    int rLen = 0;
+    char state;
+    int led = -1;
+    if ( (strncmp(path, "led/", 4) == 0) && (path[4] >= '1') && (path[4] <= '3') && (path[5] == 0) ) led = path[4] - '1';
+
+    if ( badOption ) {
+        rCode = COAP_BAD_OPTION;
+    } else if ( strcmp(path, ".well-known/core") == 0 ) {
+        rCode = (code == COAP_GET) ? COAP_CONTENT : COAP_NOT_ALLOWED;
+        if (code == COAP_GET) {
+            rFormat = COAP_FORMAT_LINK;
+            rPayload = core;
+            rLen = sizeof(core)-1;
+        }
+    } else if ( led >= 0 ) {
+        if ( code == COAP_PUT ) {
+            if ( (payloadLen == 1) && ((payload[0] == '0') || (payload[0] == '1')) ) {
+                if ( ((ppp.ledState >> led) & 1) != (payload[0] - '0') ) ledToggle(led); // only send on the radio if it changes
+                rCode = COAP_CHANGED;
+            } else if ( (payloadLen == 6) && (strncmp(payload, "toggle", 6) == 0) ) {
+                ledToggle(led);
+                rCode = COAP_CHANGED;
+            } else {
+                rCode = COAP_BAD_REQUEST;
+            }
+        } else if ( code == COAP_GET ) {
+            rCode = COAP_CONTENT;
+            if ( (observe >= 0) && coapObserve(led, token, tkl, observe) ) rObserve = ppp.coap.seq & 0xffffff;
+            state = '0' + ((ppp.ledState >> led) & 1);
+            rFormat = COAP_FORMAT_TEXT;
+            rPayload = &state;
+            rLen = 1;
+        } else {
+            rCode = COAP_NOT_ALLOWED;
+        }
+    }
+    int n = coapMessage(msg, rType, rCode, rMid, token, tkl, rObserve, rFormat, rPayload, rLen);
+    sendUdp(__REV(ppp.ip->dstAdrR), __REV(ppp.ip->srcAdrR), __REV16(ppp.udp->dstPortR), __REV16(ppp.udp->srcPortR), msg, n);
+    coapNotify(); // tell the observers if a PUT changed a led
+}
+
 /// Process an incoming UDP packet.
 /// If the packet starts with the string "echo " or "test" we echo back a special packet
 void UDPpacket()
@@ -373,6 +1008,11 @@ void UDPpacket()
     udpLength.all = __REV16( ppp.udp->lengthR ); // size of udp packet
     udpLength.data = udpLength.all - 8; // size of udp data
 
+    if ( __REV16( ppp.udp->dstPortR ) == COAP_PORT ) { // coap request
+        coapHandler(ppp.udp->data, udpLength.data);
+        return;
+    }
+
     int echoFound = !strncmp(ppp.udp->data,"echo ",5); // true if UDP message starts with "echo "
     int testFound = !strncmp(ppp.udp->data,"test" ,4); // true if UDP message starts with "test"
     if ( (echoFound) || (testFound)) { // if the UDP message starts with "echo " or "test" we answer back
@@ -400,7 +1040,26 @@ void UDPpacket()
             unsigned int dI = __REV( ppp.ip->dstAdrR );
             unsigned int sp = __REV16( ppp.udp->srcPortR );
             unsigned int dp = __REV16( ppp.udp->dstPortR );
-            int n=sprintf(ppp.pkt.buf+200,"Response Count %d\n", ppp.responseCounter);
+            ct_tx_stats_t radio;
+            Genfsk_GetTxStats(&radio);
+            int n=sprintf(ppp.pkt.buf+200,"Response Count %d\nRx Queue %d Max %d Drops %d\n", ppp.responseCounter, pppRxQueueDepth(), ppp.rx.maxDepth, ppp.rx.drops);
+            n=n+sprintf(ppp.pkt.buf+200+n,"Radio Queue %d Max %d Sent %u Failed %u Drops %u Merged %u Wait avg %uus max %uus\n", radio.depth, radio.maxDepth,
+                        (unsigned)radio.sent, (unsigned)radio.failed, (unsigned)radio.dropped, (unsigned)radio.coalesced, (unsigned)(radio.sent ? radio.waitSumUs/radio.sent : 0), (unsigned)radio.maxWaitUs);
+            for (int node=1; node<=3; node++) { // the radio nodes the leds are mirrored to
+                ct_node_stats_t link;
+                if ( !Genfsk_GetNodeStats(node, &link) ) break; // built without acknowledged delivery
+                n=n+sprintf(ppp.pkt.buf+200+n,"Node %d Acked %u Retries %u Lost %u Rtt last %uus min %uus max %uus avg %uus\n", node,
+                            (unsigned)link.acked, (unsigned)link.retries, (unsigned)link.lost, (unsigned)link.rttLastUs,
+                            (unsigned)link.rttMinUs, (unsigned)link.rttMaxUs, (unsigned)(link.acked ? link.rttSumUs/link.acked : 0));
+                if ( link.link.seen ) { // how the node hears us, relayed in its acks
+                    unsigned int frames = link.link.received + link.link.missed;
+                    unsigned int perMille = frames ? (unsigned)((link.link.missed*1000ull)/frames) : 0;
+                    n=n+sprintf(ppp.pkt.buf+200+n,"Link Rx %u Missed %u Dup %u Crc %u PER %u.%u%% Rssi %u/%u/%u/%u/%u/%u\n",
+                                (unsigned)link.link.received, (unsigned)link.link.missed, (unsigned)link.link.duplicates, (unsigned)link.link.crcFailed,
+                                perMille/10, perMille%10, link.link.rssiHist[0], link.link.rssiHist[1], link.link.rssiHist[2],
+                                link.link.rssiHist[3], link.link.rssiHist[4], link.link.rssiHist[5]);
+                }
+            }
             sendUdp(dI,sI,dp,sp,ppp.pkt.buf+200,n); // build a udp packet from the ground up
         }
     }
@@ -424,14 +1083,15 @@ void ICMPpacket()   // internet control message protocol
     icmpLength.data = icmpLength.all - 8; // length of icmp data
 #define ICMP_TYPE_PING_REQUEST 8
     if ( ppp.icmp->type == ICMP_TYPE_PING_REQUEST ) {
+        // only two header words change, so both checksums are adjusted instead of recomputed over the whole ping
+        unsigned int oldWord = get16(ppp.ipStart+8); // ttl and protocol
         ppp.ip->ttl--; // decrement time to live (so we have to update header checksum)
-        swapIpAddresses(); // swap the IP source and destination addresses
-        IpHeaderCheckSum();  // new ip header checksum (required because we changed TTL)
+        swapIpAddresses(); // swap the IP source and destination addresses, this doesn't change any checksum
+        ppp.ip->checksumR = __REV16( checkSumAdjust(__REV16(ppp.ip->checksumR), oldWord, get16(ppp.ipStart+8)) ); // new ip header checksum (required because we changed TTL)
 #define ICMP_TYPE_ECHO_REPLY 0
+        oldWord = get16(ppp.icmpStart); // type and code
         ppp.icmp->type = ICMP_TYPE_ECHO_REPLY; // icmp echo reply
-        ppp.icmp->checkSumR = 0; // zero the checksum for recalculation
-        unsigned int sum = dataCheckSum(ppp.icmpStart, icmpLength.all, 1); // icmp checksum
-        ppp.icmp->checkSumR = __REV16( sum ); // save big-endian icmp checksum
+        ppp.icmp->checkSumR = __REV16( checkSumAdjust(__REV16(ppp.icmp->checkSumR), oldWord, get16(ppp.icmpStart)) ); // save big-endian icmp checksum
 
         int printSize = icmpLength.data; // exclude size of icmp header
         if (printSize > 10) printSize = 10; // print up to 20 characters
@@ -467,77 +1127,406 @@ void enc64(char * in, char * out, int len)
     out[j]=0;
 }
 
-#define TCP_FLAG_ACK (1<<4)
-#define TCP_FLAG_SYN (1<<1)
-#define TCP_FLAG_PSH (1<<3)
-#define TCP_FLAG_RST (1<<2)
-#define TCP_FLAG_FIN (1<<0)
+/// decide if the connection stays open after our response.
+/// HTTP/1.1 connections persist unless the request says "Connection: close", HTTP/1.0 ones only if it asks for keep-alive
+int httpKeepAlive(char * request)
+{
+    if ( strstr(request, "Connection: close") || strstr(request, "connection: close") ) return 0;
+    if ( strstr(request, "Connection: keep-alive") || strstr(request, "Connection: Keep-Alive") ) return 1;
+    char * eol = strstr(request, "\r\n"); // end of the request line
+    return (eol != NULL) && (eol-request >= 8) && (strncmp(eol-8, "HTTP/1.1", 8) == 0);
+}
+
+/// find the Sec-WebSocket-Key in a websocket upgrade request, NULL if it isn't one
+char * wsKey(char * request)
+{
+    if ( (strstr(request, "Upgrade: websocket") == NULL) && (strstr(request, "upgrade: websocket") == NULL) ) return NULL;
+    char * key = strstr(request, "Sec-WebSocket-Key: ");
+    if (key == NULL) key = strstr(request, "sec-websocket-key: ");
+    if (key == NULL) return NULL;
+    return key + 19;
+}
+
+/// answer a websocket upgrade request (RFC 6455): Sec-WebSocket-Accept is the base64 of the SHA-1 of the key and a fixed GUID.
+/// returns the byte size of the response
+int wsUpgrade(char * request, tcpConnType * conn)
+{
+    char keyGuid[100];
+    char hash[20];
+    char accept[32];
+    char * key = wsKey(request);
+    int keyLen = strcspn(key, "\r\n ");
+    if (keyLen > 60) keyLen = 60; // keys are 24 characters
+    memcpy(keyGuid, key, keyLen);
+    strcpy(keyGuid+keyLen, "258EAFA5-E914-47DA-95CA-C5AB0DC85B11");
+    sha1(hash, keyGuid, strlen(keyGuid));
+    enc64(hash, accept, 20);
+
+    int n=0;
+    char * dataStart = conn->out.hdr;
+    n=n+sprintf(n+dataStart,"HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n");
+    n=n+sprintf(n+dataStart,"Sec-WebSocket-Accept: %s\r\n\r\n", accept);
+    conn->out.hdrLen = n;
+    conn->out.body = NULL;
+    conn->out.bodySum = NULL;
+    conn->out.bodyLen = 0;
+    conn->out.fin = 0;
+    conn->ws = 1;
+    conn->wsPending = 7; // start with the state of all leds
+    return n;
+}
+
+/// put one unmasked websocket frame into the retransmission buffer of conn, returns its byte size
+int wsFrame(tcpConnType * conn, int opcode, char * payload, int len)
+{
+    conn->out.hdr[0] = 0x80 | opcode; // final fragment
+    conn->out.hdr[1] = len; // we only send short frames
+    memcpy(conn->out.hdr+2, payload, len);
+    conn->out.hdrLen = 2 + len;
+    conn->out.body = NULL;
+    conn->out.bodySum = NULL;
+    conn->out.bodyLen = 0;
+    return 2 + len;
+}
+
+/// handle the websocket frames in an incoming TCP segment. A text frame with a, b or c toggles that led.
+/// we answer pings and close frames; state updates are queued and go out in wsFlush
+/// returns the byte size of the response, 0 if there is none
+int wsReceive(char * data, int size, tcpConnType * conn)
+{
+    int out = 0;
+    while (size >= 2) {
+        int opcode = data[0] & 0x0f;
+        int len = data[1] & 0x7f;
+        int hdrLen = 2;
+        if (len == 126) {
+            if (size < 4) break;
+            len = get16(data+2);
+            hdrLen = 4;
+        } else if (len == 127) break; // too big for us anyway
+        char * mask = NULL;
+        if (data[1] & 0x80) { // client frames are always masked
+            mask = data + hdrLen;
+            hdrLen += 4;
+        }
+        if (hdrLen + len > size) break; // we don't reassemble frames split over segments
+        char * payload = data + hdrLen;
+        for (int i=0; mask && (i<len); i++) payload[i] ^= mask[i&3];
+
+        if (opcode == 1) { // text
+            for (int i=0; i<len; i++) {
+                if ( (payload[i] >= 'a') && (payload[i] <= 'c') ) ledToggle(payload[i] - 'a');
+            }
+        } else if ( (opcode == 9) && (out == 0) && (len <= 125) ) { // ping
+            out = wsFrame(conn, 10, payload, len); // pong
+        } else if (opcode == 8) { // close
+            out = wsFrame(conn, 8, payload, len < 2 ? len : 2); // echo the status code
+            conn->out.fin = 1;
+            conn->ws = 0;
+            break;
+        }
+        data += hdrLen + len;
+        size -= hdrLen + len;
+    }
+    return out;
+}
+
+/// find the asset for the path in an HTTP request, any path we don't know gets the root page
+const webAssetType * webAssetFind(char * request)
+{
+    char * path = request + 4; // after "GET "
+    int len = strcspn(path, " ?\r\n");
+    for (int i=0; i<(int)WEB_ASSETS; i++) {
+        if ( ((int)strlen(webAssets[i].path) == len) && (strncmp(webAssets[i].path, path, len) == 0) ) return &webAssets[i];
+    }
+    return &webAssets[0];
+}
+
+/// check if the client accepts gzip compressed content
+int httpAcceptsGzip(char * request)
+{
+    char * accept = strstr(request, "Accept-Encoding:");
+    if (accept == NULL) accept = strstr(request, "accept-encoding:");
+    if (accept == NULL) return 0;
+    int len = strcspn(accept, "\r\n"); // only look at this header line
+    char * gz = strstr(accept, "gzip");
+    return (gz != NULL) && (gz < accept + len);
+}
+
+/// check if the client already has this version of the asset: If-None-Match lists its ETag or is "*"
+int httpNotModified(char * request, const char * etag)
+{
+    char * match = strstr(request, "If-None-Match:");
+    if (match == NULL) match = strstr(request, "if-none-match:");
+    if (match == NULL) return 0;
+    int len = strcspn(match, "\r\n"); // only look at this header line
+    char * found = strstr(match, etag);
+    if ( (found != NULL) && (found < match + len) ) return 1;
+    found = strchr(match, '*');
+    return (found != NULL) && (found < match + len);
+}
 
 /// respond to an HTTP request
-int httpResponse(char * dataStart, int * flags)
+/// the header is printed into the retransmission buffer of the connection, the body is referenced where it is (usually in flash)
+/// returns the total byte size of the response
+int httpResponse(char * request, tcpConnType * conn)
 {
     int n=0; // number of bytes we have printed so far
+    char * dataStart = conn->out.hdr;
+    const webAssetType * asset = NULL;
+    const char * body = NULL;
+    const unsigned short * bodySum = NULL;
+    int bodyLen = 0;
+    int gzip = 0;
+    const char * etag = NULL;
+    int notModified = 0;
 
-    int nHeader; // byte size of HTTP header
-    int contentLengthStart; // index where HTML starts
     int httpGet5, httpGetRoot; // temporary storage of strncmp results
-    *flags = TCP_FLAG_ACK | TCP_FLAG_FIN; // the default case is that we close the connection
+    int keepAlive = httpKeepAlive(request);
+    conn->out.fin = !keepAlive; // close the connection after the response unless the client wants to keep it
 
-    httpGetRoot = strncmp(dataStart, "GET /", 5);  // found a GET to the root directory
-    httpGet5    = dataStart[5]; // the first character in the path name, we use it for special functions later on
+    httpGetRoot = strncmp(request, "GET /", 5);  // found a GET to the root directory
+    httpGet5    = request[5]; // the first character in the path name, we use it for special functions later on
+
+    if( httpGetRoot == 0 ) {
+        if ( (httpGet5 >= 'a') && (httpGet5 <= 'c') ) ledToggle(httpGet5 - 'a'); // Toggle led
+        if ( (strncmp(request+4, "/ws ", 4) == 0) && wsKey(request) ) return wsUpgrade(request, conn); // switch this connection to a websocket
+        // our web pages are sent straight from flash, compressed if the browser can take it
+        asset = webAssetFind(request);
+        gzip = httpAcceptsGzip(request);
+        body = gzip ? asset->gz : asset->data;
+        bodyLen = gzip ? asset->gzLen : asset->len;
+        bodySum = gzip ? asset->gzSum : asset->sum;
+        etag = gzip ? asset->gzEtag : asset->etag;
+        notModified = httpNotModified(request, etag); // the browser has it cached, the led was still toggled above
+    }
 
-    if((httpGetRoot==0)) {
+    if (notModified) {
+        n=n+sprintf(n+dataStart,"HTTP/1.1 304 Not Modified\r\nServer: Blinky-Radio\r\n"); // 304 header, no body
+        body = NULL;
+        bodyLen = 0;
+    } else if((httpGetRoot==0)) {
         n=n+sprintf(n+dataStart,"HTTP/1.1 200 OK\r\nServer: Blinky-Radio\r\n"); // 200 OK header
     } else {
         n=n+sprintf(n+dataStart,"HTTP/1.1 404 Not Found\r\nServer: Blinky-Radio\r\n"); // 404 header
     }
-    n=n+sprintf(n+dataStart,"Content-Length: "); // http header
-    contentLengthStart = n; // remember where Content-Length is in buffer
-    n=n+sprintf(n+dataStart,"?????\r\n"); // leave five spaces for content length - will be updated later
-    n=n+sprintf(n+dataStart,"Connection: close\r\n"); // close connection immediately
-    n=n+sprintf(n+dataStart,"Content-Type: text/html; charset=us-ascii\r\n\r\n"); // http header must end with empty line (\r\n)
-    nHeader=n; // size of HTTP header
-    
-    if( httpGetRoot == 0 ) {
-    	if (httpGet5 == 'a') {
-        	// Toggle led
-        	static uint8_t ledState1 = 0;
-
-        	ledState1 = ledState1 ? 0 : 1;
-        	Genfsk_Send(gCtEvtTxDone_c, NULL, ledState1,1);
-        	Led2Toggle();
-    	}
-    	if (httpGet5 == 'b') {
-    	    // Toggle led
-    	    static uint8_t ledState2 = 0;
-
-    	    ledState2 = ledState2 ? 0 : 1;
-    	    Genfsk_Send(gCtEvtTxDone_c, NULL, ledState2,2);
-    	    Led3Toggle();
-    	}
-    	if (httpGet5 == 'c') {
-    	    // Toggle led
-    	    static uint8_t ledState3 = 0;
-
-    	    ledState3 = ledState3 ? 0 : 1;
-    	    Genfsk_Send(gCtEvtTxDone_c, NULL, ledState3,3);
-    	    Led4Toggle();
-    	}
-        // this is where we insert our web page into the buffer
-        memcpy(n+dataStart,rootWebPage,sizeof(rootWebPage));
-        n = n + sizeof(rootWebPage)-1; // one less than sizeof because we don't count the null byte at the end
-
-    }
-
-#define CONTENTLENGTHSIZE 5
-    char contentLengthString[CONTENTLENGTHSIZE+1];
-    snprintf(contentLengthString,CONTENTLENGTHSIZE+1,"%*d",CONTENTLENGTHSIZE,n-nHeader); // print Content-Length with leading spaces and fixed width equal to csize
-    memcpy(dataStart+contentLengthStart, contentLengthString, CONTENTLENGTHSIZE); // copy Content-Length to it's place in the send buffer
-    return n; // total byte size of our response
+    if (!notModified) n=n+sprintf(n+dataStart,"Content-Length: %d\r\n", bodyLen); // http header
+    if (keepAlive) {
+        n=n+sprintf(n+dataStart,"Connection: keep-alive\r\n"); // next request can use the same connection
+    } else {
+        n=n+sprintf(n+dataStart,"Connection: close\r\n"); // close connection immediately
+    }
+    if (asset) {
+        n=n+sprintf(n+dataStart,"ETag: %s\r\nCache-Control: no-cache\r\n", etag); // the browser checks back with the ETag every time
+        n=n+sprintf(n+dataStart,"Vary: Accept-Encoding\r\n"); // caches must keep both variants apart
+    }
+    if (asset && !notModified) {
+        if (gzip) n=n+sprintf(n+dataStart,"Content-Encoding: gzip\r\n");
+        n=n+sprintf(n+dataStart,"Content-Type: %s\r\n", asset->type);
+    }
+    n=n+sprintf(n+dataStart,"\r\n"); // http header must end with empty line (\r\n)
+
+    conn->out.hdrLen = n;
+    conn->out.body = body;
+    conn->out.bodySum = bodySum;
+    conn->out.bodyLen = bodyLen;
+    return n + bodyLen; // total byte size of our response
+}
+
+/// free the connection slots that have been idle for more than TCP_IDLE_MS
+void tcpExpire(unsigned int now)
+{
+    for (int i=0; i<TCP_CONNECTIONS; i++) {
+        if ( ppp.conn[i].state && (now - ppp.conn[i].lastActive > TCP_IDLE_MS) ) {
+            ppp.conn[i].state = TCP_FREE;
+        }
+    }
+}
+
+/// find the connection slot of the incoming TCP packet, NULL if we don't know this connection
+tcpConnType * tcpFind()
+{
+    for (int i=0; i<TCP_CONNECTIONS; i++) {
+        tcpConnType * c = &ppp.conn[i];
+        if ( c->state && (c->remoteIpR == ppp.ip->srcAdrR) && (c->remotePortR == ppp.tcp->srcPortR) && (c->localPortR == ppp.tcp->dstPortR) ) {
+            return c;
+        }
+    }
+    return NULL;
+}
+
+/// take a connection slot for the incoming TCP packet: a free one, or else the least recently used one.
+/// our sequence numbers start at snd, theirs at rcv
+tcpConnType * tcpAlloc(unsigned int now, unsigned int snd, unsigned int rcv)
+{
+    tcpConnType * c = &ppp.conn[0];
+    for (int i=0; i<TCP_CONNECTIONS; i++) {
+        if ( ppp.conn[i].state == TCP_FREE ) {
+            c = &ppp.conn[i];
+            break;
+        }
+        if ( now - ppp.conn[i].lastActive > now - c->lastActive ) c = &ppp.conn[i];
+    }
+    memset(c, 0, sizeof(*c));
+    c->state = TCP_OPEN;
+    c->remoteIpR = ppp.ip->srcAdrR;
+    c->localIpR = ppp.ip->dstAdrR;
+    c->remotePortR = ppp.tcp->srcPortR;
+    c->localPortR = ppp.tcp->dstPortR;
+    c->sndUna = snd;
+    c->sndNxt = snd;
+    c->out.seq = snd;
+    c->rcvNxt = rcv;
+    c->mss = TCP_DEFAULT_MSS;
+    c->lastActive = now;
+    return c;
+}
+
+/// get the peer's maximum segment size from the options of a SYN packet
+int tcpMss()
+{
+    int mss = TCP_DEFAULT_MSS; // what we must assume without an MSS option
+    char * opt = ppp.tcpStart + 20;
+    int len = 4 * ppp.tcp->offset - 20;
+    for (int i=0; i<len; ) {
+        if (opt[i] == 0) break; // end of option list
+        if (opt[i] == 1) { // no-operation
+            i++;
+            continue;
+        }
+        if ( (i+1 >= len) || ((opt[i+1]&0xff) < 2) ) break;
+        if ( (opt[i] == 2) && (opt[i+1] == 4) ) mss = get16(opt+i+2); // maximum segment size
+        i += opt[i+1] & 0xff;
+    }
+    if (mss > TCP_MAX_MSS) mss = TCP_MAX_MSS; // we can't build bigger ones
+    return mss;
+}
+
+/// build and send one TCP segment from scratch: len bytes of the pending response of conn, starting at sequence number seq
+void tcpSendSegment(tcpConnType * conn, unsigned int seq, int len, int flags)
+{
+    memset(ppp.ipStart, 0, 40); // clear all header fields we don't set
+    initIP(__REV(conn->localIpR), __REV(conn->remoteIpR), __REV16(conn->localPortR), __REV16(conn->remotePortR), 6); // init a TCP packet
+    ppp.tcp->seqTcpR = __REV( seq ); // byte reversed - tcp/ip messages are big-endian (high byte first)
+    ppp.tcp->ackTcpR = __REV( conn->rcvNxt );
+    ppp.tcp->offset = 5; // 20 bytes, no options
+    ppp.tcp->flag.All = flags;
+    ppp.tcp->windowR = __REV16( 1200 ); // set tcp window size to 1200 bytes
+
+    // the payload is gathered from the response header in ram and the body wherever it is, nothing is copied
+    txSegType seg[2];
+    int count = 0;
+    int offset = seq - conn->out.seq;
+    int n = conn->out.hdrLen - offset; // part in the header
+    if (n > len) n = len;
+    if (n < 0) n = 0;
+    if (n) {
+        seg[count].data = conn->out.hdr + offset;
+        seg[count++].len = n;
+    }
+    if (len > n) {
+        seg[count].data = conn->out.body + offset + n - conn->out.hdrLen;
+        seg[count++].len = len - n;
+    }
+
+    int tcpSize = 20 + len; // tcp packet size
+    ppp.ip->lengthR = __REV16( 20 + tcpSize );
+    ppp.pkt.len = 20 + tcpSize + 4 + 2; // ip packet length + 4-byte ppp prefix (ff 03 00 21) + 2 fcs (crc) bytes bytes at the end of the packet
+
+    // the header is all set up, now do the IP and TCP checksums
+    IpHeaderCheckSum(); // calculate new IP header checksum
+    checkSumPseudoHeader( tcpSize ); // get the TCP pseudo-header checksum
+    ppp.tcp->checksumR = 0; // before TCP checksum calculations the checksum bytes must be set cleared
+    dataCheckSum(ppp.tcpStart, 20, 0); // continue the TCP checksum on the TCP header
+    unsigned int sum = ppp.sum;
+    if (n) sum = onesSumAdd(sum, 0, onesSum(seg[0].data, n)); // the header part follows the 20 byte tcp header
+    if (len > n) sum = onesSumAdd(sum, n, bodySum(conn->out.body, conn->out.bodySum, offset + n - conn->out.hdrLen, len - n)); // the body mostly from its precomputed block sums
+    ppp.tcp->checksumR = __REV16( ~sum ); // tcp checksum done, store it in the TCP header
+
+    sendPppFrameSegments(seg, count); // All preparation complete - send the TCP segment
+}
+
+/// send as much of the pending response of conn as the peer's window allows, in segments of at most its MSS.
+/// the FIN goes out with the last segment if we close. Returns the number of segments sent
+int tcpSendPending(tcpConnType * conn, unsigned int now)
+{
+    unsigned int end = conn->out.seq + conn->out.len; // sequence number after the last byte of the response
+    int sent = 0;
+    while ( (int)(end - conn->sndNxt) >= 0 ) { // anything left, or at least the FIN
+        int len = end - conn->sndNxt;
+        int room = conn->sndWnd - (int)(conn->sndNxt - conn->sndUna); // what the peer's window still allows
+        if (len > conn->mss) len = conn->mss;
+        if (len > room) len = room;
+        if (len < 0) len = 0;
+        int fin = conn->out.fin && (conn->sndNxt + len == end);
+        if ( (len == 0) && !fin ) break;
+        int flags = TCP_FLAG_ACK;
+        if ( conn->sndNxt + len == end ) flags |= TCP_FLAG_PSH; // last segment of the response
+        if ( fin ) flags |= TCP_FLAG_FIN;
+        tcpSendSegment(conn, conn->sndNxt, len, flags);
+        conn->sndNxt += len + fin; // the FIN counts as one byte
+        conn->out.sentTime = now;
+        sent++;
+        if ( fin ) {
+            conn->state = TCP_CLOSING;
+            break;
+        }
+    }
+    return sent;
+}
+
+/// free the slot once both sides have closed and our FIN was acked
+void tcpCheckClosed(tcpConnType * conn)
+{
+    if ( (conn->state == TCP_CLOSING) && conn->finRcvd && (conn->sndUna == conn->sndNxt) ) {
+        conn->state = TCP_FREE;
+    }
+}
+
+/// send the queued led state updates to the websocket clients which have nothing in flight, as "a1b0..." text frames
+void wsFlush(unsigned int now)
+{
+    for (int i=0; i<TCP_CONNECTIONS; i++) {
+        tcpConnType * conn = &ppp.conn[i];
+        if ( (conn->state != TCP_OPEN) || !conn->ws || !conn->wsPending ) continue;
+        if ( conn->sndUna != conn->out.seq + conn->out.len ) continue; // still busy
+        char msg[2*8];
+        int n = 0;
+        for (int led=0; led<3; led++) {
+            if ( conn->wsPending & (1<<led) ) {
+                msg[n++] = 'a' + led;
+                msg[n++] = '0' + ((ppp.ledState>>led)&1);
+            }
+        }
+        conn->wsPending = 0;
+        conn->out.seq = conn->sndNxt;
+        conn->out.len = wsFrame(conn, 1, msg, n);
+        conn->out.retries = 0;
+        tcpSendPending(conn, now);
+    }
+}
+
+/// resend unacknowledged data of all connections after the retransmission timeout, doubling the timeout on every retry
+void tcpPoll()
+{
+    unsigned int now = OSA_TimeGetMsec();
+    for (int i=0; i<TCP_CONNECTIONS; i++) {
+        tcpConnType * conn = &ppp.conn[i];
+        if ( (conn->state == TCP_FREE) || (conn->sndUna == conn->sndNxt) ) continue; // nothing in flight
+        if ( now - conn->out.sentTime < ((unsigned int)TCP_RTO_MS << conn->out.retries) ) continue;
+        if ( ++conn->out.retries > TCP_MAX_RETRIES ) {
+            conn->state = TCP_FREE; // the peer is gone
+            continue;
+        }
+        conn->sndNxt = conn->sndUna; // go back and resend everything unacked
+        tcpSendPending(conn, now);
+    }
 }
 
 /// handle an incoming TCP packet
-/// use the first few bytes to figure out if it's a websocket, an http request or just pure incoming TCP data
+/// every connection has a slot in ppp.conn with its sequence numbers and a retransmission buffer for the response,
+/// so HTTP/1.1 connections can stay open, several clients can talk to us at the same time
+/// and responses can be bigger than one segment
 void tcpHandler()
 {
     int packetLengthIp = __REV16(ppp.ip->lengthR ); // size of ip packet
@@ -547,78 +1536,88 @@ void tcpHandler()
     int headerSizeTcp = 4 * (ppp.tcp->offset); // tcp "offset" for start of data is also the header size
     char * tcpDataIn = ppp.tcpStart + headerSizeTcp; // start of data TCP data after TCP header
     int tcpDataSize = tcpSize - headerSizeTcp; // size of data block after TCP header
+    if ( (tcpDataSize < 0) || (4+packetLengthIp+2 > PPP_max_size) ) return; // malformed
+    tcpDataIn[tcpDataSize] = 0; // terminate the request so we can search it as a string
 
     unsigned int seq_in = __REV(ppp.tcp->seqTcpR);
     unsigned int ack_in = __REV(ppp.tcp->ackTcpR);
-    unsigned int ack_out = seq_in + tcpDataSize;
-    unsigned int seq_out = ack_in; // use their version of our current sequence number
-
-    // first we shorten the TCP response header to only 20 bytes. This means we ignore all TCP option requests
-    headerSizeIp=20;
-    ppp.ip->headerLength = headerSizeIp/4; // ip header is 20 bytes long
-    ppp.ip->lengthR = __REV(40); // 20 ip header + 20 tcp header
-    headerSizeTcp = 20; // shorten outgoing TCP header size 20 bytes
-    ppp.tcpStart = ppp.ipStart + headerSizeIp; // recalc TCP header start
-    ppp.tcp->offset = (headerSizeTcp/4);
-    char * tcpDataOut = ppp.tcpStart + headerSizeTcp; // start of outgoing data
-
-    int dataLen = 0; // most of our responses will have zero TCP data, only a header
-    int flagsOut = TCP_FLAG_ACK; // the default case is an ACK packet
+    unsigned int window = __REV16(ppp.tcp->windowR) & 0xffff;
+    int flagsIn = ppp.tcp->flag.All;
+    unsigned int now = OSA_TimeGetMsec();
+
+    tcpExpire(now);
+    tcpConnType * conn = tcpFind();
+    if ( flagsIn & TCP_FLAG_RST ) { // they reset the connection - forget it
+        if (conn) conn->state = TCP_FREE;
+        return;
+    }
 
-    ppp.tcp->windowR = __REV16( 1200 ); // set tcp window size to 1200 bytes
+    if ( flagsIn & TCP_FLAG_SYN ) { // something wants to connect (a SYN on a known connection restarts it)
+        unsigned int iss = seq_in+0x10000000U; // create a new sequence number using their sequence as a starting point, increase the highest digit
+        if (conn == NULL) conn = tcpAlloc(now, iss+1, seq_in+1); // for SYN flag we have to increase the sequence by 1
+        else {
+            tcpConnType * restart = tcpAlloc(now, iss+1, seq_in+1);
+            conn->state = TCP_FREE; // in case tcpAlloc picked another slot
+            conn = restart;
+        }
+        conn->mss = tcpMss();
+        conn->sndWnd = window;
+        tcpSendSegment(conn, iss, 0, TCP_FLAG_SYN | TCP_FLAG_ACK); // acknowledge it
+        return;
+    }
+    if ( !(flagsIn & (TCP_FLAG_ACK|TCP_FLAG_FIN)) ) return; // ignore all other packets
+    if ( conn == NULL ) {
+        if ( (tcpDataSize == 0) && !(flagsIn & TCP_FLAG_FIN) ) return; // handle stray zero-size ack messages by ignoring them
+        conn = tcpAlloc(now, ack_in, seq_in); // we lost track of this connection, carry on from the sequence numbers they use
+    }
+    conn->lastActive = now;
 
-    // A sparse TCP flag interpreter that implements stateless TCP connections
+    if ( flagsIn & TCP_FLAG_ACK ) { // they acked some of our data
+        if ( ((int)(ack_in - conn->sndUna) > 0) && ((int)(ack_in - conn->sndNxt) <= 0) ) {
+            conn->sndUna = ack_in;
+            conn->out.retries = 0;
+            conn->out.sentTime = now;
+        }
+        conn->sndWnd = window;
+        tcpCheckClosed(conn);
+        if ( conn->state == TCP_FREE ) return;
+    }
 
-    switch ( ppp.tcp->flag.All ) {
-        case TCP_FLAG_SYN:
-            flagsOut = TCP_FLAG_SYN | TCP_FLAG_ACK; // something wants to connect - acknowledge it
-            seq_out = seq_in+0x10000000U; // create a new sequence number using their sequence as a starting point, increase the highest digit
-            ack_out++; // for SYN flag we have to increase the sequence by 1
-            break;
-        case TCP_FLAG_ACK:
-        case TCP_FLAG_ACK | TCP_FLAG_PSH:
-            if ( (ppp.tcp->flag.All == TCP_FLAG_ACK) && (tcpDataSize == 0)) return; // handle zero-size ack messages by ignoring them
-            if ( (strncmp(tcpDataIn, "GET /", 5) == 0) ) { // check for an http GET command
-                flagsOut = TCP_FLAG_ACK | TCP_FLAG_PSH; // we have data, set the PSH flag
-                dataLen = httpResponse(tcpDataOut, &flagsOut); // send an http response
+    int ackNeeded = 0;
+    if ( tcpDataSize || (flagsIn & TCP_FLAG_FIN) ) {
+        ackNeeded = 1; // tell them what we expect next, even if this was a duplicate
+        unsigned int end = conn->out.seq + conn->out.len + conn->out.fin;
+        if ( seq_in != conn->rcvNxt ) {
+            if ( (int)(seq_in - conn->rcvNxt) < 0 ) conn->sndNxt = conn->sndUna; // they resent old data, so they may have lost our answer too
+        } else if ( tcpDataSize && (conn->sndUna != end) ) {
+            // still busy with the previous response, don't take the request yet - they will resend it
+        } else {
+            conn->rcvNxt += tcpDataSize;
+            if ( tcpDataSize && (conn->state == TCP_OPEN) && conn->ws ) { // websocket frames
+                conn->out.seq = conn->sndNxt;
+                conn->out.len = wsReceive(tcpDataIn, tcpDataSize, conn);
+                conn->out.retries = 0;
+            } else if ( tcpDataSize && (conn->state == TCP_OPEN) && (strncmp(tcpDataIn, "GET /", 5) == 0) ) { // check for an http GET command
+                conn->out.seq = conn->sndNxt;
+                conn->out.len = httpResponse(tcpDataIn, conn); // queue an http response
+                conn->out.retries = 0;
             }
-            break;
-        case TCP_FLAG_FIN:
-        case TCP_FLAG_FIN | TCP_FLAG_ACK:
-        case TCP_FLAG_FIN | TCP_FLAG_PSH | TCP_FLAG_ACK:
-            flagsOut = TCP_FLAG_ACK | TCP_FLAG_FIN; // set outgoing FIN flag to ask them to close from their side
-            ack_out++; // for FIN flag we have to increase the sequence by 1
-            break;
-        default:
-            return; // ignore all other packets
-    } // switch
-
-    // The TCP flag handling is now done
-    // first we swap source and destination TCP addresses and insert the new ack and seq numbers
-    swapIpAddresses(); // swap IP source and destination addresses
-    swapIpPorts(); // swap IP  source and destination ports
-
-    ppp.tcp->ackTcpR = __REV( ack_out ); // byte reversed - tcp/ip messages are big-endian (high byte first)
-    ppp.tcp->seqTcpR = __REV( seq_out ); // byte reversed - tcp/ip messages are big-endian (high byte first)
-
-    ppp.tcp->flag.All = flagsOut; // update the TCP flags
-
-    // recalculate all the header sizes
-    tcpSize = headerSizeTcp + dataLen; // tcp packet size
-    int newPacketSize = headerSizeIp + tcpSize; // calculate size of the outgoing packet
-    ppp.ip->lengthR = __REV16 ( newPacketSize );
-    ppp.pkt.len = newPacketSize+4+2; // ip packet length + 4-byte ppp prefix (ff 03 00 21) + 2 fcs (crc) bytes bytes at the end of the packet
-
-    // the header is all set up, now do the IP and TCP checksums
-    IpHeaderCheckSum(); // calculate new IP header checksum
-    checkSumPseudoHeader( tcpSize ); // get the TCP pseudo-header checksum
-    ppp.tcp->checksumR = 0; // before TCP checksum calculations the checksum bytes must be set cleared
-    unsigned int pseudoHeaderSum=dataCheckSum(ppp.tcpStart,tcpSize, 0); // continue the TCP checksum on the whole TCP packet
-    ppp.tcp->checksumR = __REV16( pseudoHeaderSum); // tcp checksum done, store it in the TCP header
-
-    sendPppFrame(); // All preparation complete - send the TCP response
+            if ( flagsIn & TCP_FLAG_FIN ) {
+                conn->rcvNxt++; // for FIN flag we have to increase the sequence by 1
+                conn->finRcvd = 1;
+                if ( conn->state == TCP_OPEN ) { // close from our side too, after the rest of the response
+                    conn->out.fin = 1; // tcpSendPending sends a bare FIN if all of it is sent already, the response stays for retransmission
+                }
+            }
+        }
+    }
 
-    memset(ppp.pkt.buf+44,0,500); // flush out traces of previous data that we may scan for
+    if ( (tcpSendPending(conn, now) == 0) && ackNeeded ) {
+        tcpSendSegment(conn, conn->sndNxt, 0, TCP_FLAG_ACK); // nothing to send, just the ack
+    }
+    tcpCheckClosed(conn);
+    wsFlush(now); // led changes for the websocket clients
+    coapNotify(); // and for the coap observers
 }
 
 /// process an incoming IP packet
@@ -640,27 +1639,208 @@ void IPframe()
     }
 }
 
-/// respond to LCP (line configuration protocol) configuration request) by allowing no options
+/// send our own LCP configuration request, asking for the options still set in ppp.opt.request
+void LCPsendRequest()
+{
+    char * opt = ppp.lcp->request;
+    int n=0;
+    if (ppp.opt.request & LCP_REQ_ACCM) {
+        opt[n++]=LCP_OPT_ACCM;
+        opt[n++]=6;
+        memset(opt+n, 0, 4); // we don't need any control characters escaped
+        n+=4;
+    }
+    if (ppp.opt.request & LCP_REQ_PFC) {
+        opt[n++]=LCP_OPT_PFC;
+        opt[n++]=2;
+    }
+    if (ppp.opt.request & LCP_REQ_ACFC) {
+        opt[n++]=LCP_OPT_ACFC;
+        opt[n++]=2;
+    }
+    ppp.lcp->code=1; // request
+    ppp.lcp->lengthR = __REV16( 4+n );
+    ppp.pkt.len=4+4+n+2; // 4 ppp + 4 lcp + options + 2 crc
+    sendPppFrame();
+}
+
+/// read a VJ delta from *cp and advance *cp past it
+unsigned int vjDecode(char ** cp)
+{
+    char * p = *cp;
+    if ( p[0] == 0 ) {
+        *cp = p+3;
+        return get16(p+1);
+    }
+    *cp = p+1;
+    return p[0] & 0xff;
+}
+
+/// handle a VJ uncompressed-TCP packet (protocol 0x002f): a complete TCP/IP packet with the slot id in the IP protocol field
+void vjUncompressedTcp()
+{
+    int slot = ppp.ip->protocol;
+    int hlen = 4 * ppp.ip->headerLength;
+    if ( (slot >= VJ_SLOTS) || (4+hlen+20+2 > ppp.pkt.len) ) {
+        ppp.vj.rxToss = 1; // drop compressed packets until the next good uncompressed one
+        return;
+    }
+    hlen += 4 * ((ppp.ipStart[hlen+12]>>4)&0xf); // plus tcp header
+    if ( (hlen > VJ_MAX_HDR) || (4+hlen+2 > ppp.pkt.len) ) {
+        ppp.vj.rxToss = 1;
+        return;
+    }
+    ppp.ip->protocol = 6; // tcp again, so the ip header checksum is valid again
+    memcpy(ppp.vj.rx[slot].hdr, ppp.ipStart, hlen); // the reference header of this slot
+    ppp.vj.rx[slot].len = hlen;
+    ppp.vj.rxLast = slot;
+    ppp.vj.rxToss = 0;
+    ppp.ppp->protocolR = __REV16( 0x0021 );
+    IPframe();
+}
+
+/// handle a VJ compressed-TCP packet (protocol 0x002d): rebuild the full TCP/IP header from the slot and the deltas
+void vjCompressedTcp()
+{
+    char * cp = ppp.ipStart; // the compressed header starts where an ip header would
+    char * end = ppp.pkt.buf + ppp.pkt.len - 2; // the fcs follows the tcp data
+    int changes = *cp++ & 0xff;
+    if ( changes & VJ_NEW_C ) {
+        int slot = *cp++ & 0xff;
+        if ( (slot >= VJ_SLOTS) || (ppp.vj.rx[slot].len == 0) ) {
+            ppp.vj.rxToss = 1;
+            return;
+        }
+        ppp.vj.rxLast = slot;
+        ppp.vj.rxToss = 0;
+    } else if ( ppp.vj.rxToss || (ppp.vj.rx[ppp.vj.rxLast].len == 0) ) {
+        return; // we lost track of this connection, wait for an uncompressed packet
+    }
+    char * hdr = ppp.vj.rx[ppp.vj.rxLast].hdr;
+    int hlen = ppp.vj.rx[ppp.vj.rxLast].len;
+    char * tcp = hdr + 4*(hdr[0]&0xf);
+    unsigned int oldData = get16(hdr+2) - hlen; // payload size of the previous packet
+
+    tcp[16] = *cp++; // tcp checksum is sent as is
+    tcp[17] = *cp++;
+    if ( changes & VJ_PUSH ) tcp[13] |= TCP_FLAG_PSH;
+    else tcp[13] &= ~TCP_FLAG_PSH;
+    switch ( changes & VJ_SPECIALS ) {
+        case VJ_SPECIAL_I:
+            put32(tcp+8, get32(tcp+8) + oldData);
+            put32(tcp+4, get32(tcp+4) + oldData);
+            break;
+        case VJ_SPECIAL_D:
+            put32(tcp+4, get32(tcp+4) + oldData);
+            break;
+        default:
+            if ( changes & VJ_NEW_U ) {
+                tcp[13] |= (1<<5);
+                put16(tcp+18, vjDecode(&cp));
+            } else {
+                tcp[13] &= ~(1<<5);
+            }
+            if ( changes & VJ_NEW_W ) put16(tcp+14, get16(tcp+14) + vjDecode(&cp));
+            if ( changes & VJ_NEW_A ) put32(tcp+8, get32(tcp+8) + vjDecode(&cp));
+            if ( changes & VJ_NEW_S ) put32(tcp+4, get32(tcp+4) + vjDecode(&cp));
+            break;
+    }
+    unsigned int oldWord = get16(hdr+4);
+    if ( changes & VJ_NEW_I ) put16(hdr+4, get16(hdr+4) + vjDecode(&cp));
+    else put16(hdr+4, get16(hdr+4) + 1);
+    put16(hdr+10, checkSumAdjust(get16(hdr+10), oldWord, get16(hdr+4))); // the ip header checksum follows the ident
+
+    int dataLen = end - cp;
+    if ( (dataLen < 0) || (4+hlen+dataLen+2 > PPP_max_size) ) {
+        ppp.vj.rxToss = 1;
+        return;
+    }
+    oldWord = get16(hdr+2);
+    put16(hdr+2, hlen+dataLen); // new ip length
+    put16(hdr+10, checkSumAdjust(get16(hdr+10), oldWord, get16(hdr+2))); // the compressed packet doesn't carry an ip checksum, the reference header's is adjusted
+    memmove(ppp.ipStart+hlen, cp, dataLen); // make room for the full header in front of the data
+    memcpy(ppp.ipStart, hdr, hlen);
+    ppp.pkt.len = 4+hlen+dataLen+2;
+    ppp.ppp->protocolR = __REV16( 0x0021 );
+    ppp.vj.saved += hlen - (cp - ppp.ipStart);
+    IPframe();
+}
+
+/// respond to LCP (line configuration protocol) configuration request.
+/// ACCM, PFC and ACFC are accepted, every other option is rejected which means e.g. Maximum Receive Unit (MRU) is default 1500 bytes
 void LCPconfReq()
 {
-    if ( ppp.lcp->lengthR != __REV16(4) ) {
-        ppp.lcp->code=4; // allow only "no options" which means Maximum Receive Unit (MRU) is default 1500 bytes
+    int len = __REV16( ppp.lcp->lengthR ) - 4; // size of the option list
+    char * opt = ppp.lcp->request;
+    int rejLen = 0; // rejected options are moved to the front of the option list
+    unsigned int accm = 0xffffffff;
+    int pfc = 0, acfc = 0;
+    int i = 0;
+    while ( i < len ) {
+        int type = opt[i];
+        int optLen = opt[i+1] & 0xff;
+        if ( (optLen < 2) || (i+optLen > len) ) return; // malformed option list, ignore the request
+        if ( (type==LCP_OPT_ACCM) && (optLen==6) ) {
+            accm = bufferToIP(opt+i+2); // same big-endian 32-bit layout as an IP address
+        } else if ( (type==LCP_OPT_PFC) && (optLen==2) ) {
+            pfc = 1;
+        } else if ( (type==LCP_OPT_ACFC) && (optLen==2) ) {
+            acfc = 1;
+        } else {
+            memmove(opt+rejLen, opt+i, optLen);
+            rejLen += optLen;
+        }
+        i += optLen;
+    }
+    if ( rejLen ) {
+        ppp.lcp->code=4; // reject only the options we don't support
+        ppp.lcp->lengthR = __REV16( 4+rejLen );
+        ppp.pkt.len=4+4+rejLen+2;
         sendPppFrame();
     } else {
-        ppp.lcp->code=2; // ack zero conf
-        sendPppFrame();
-        ppp.lcp->code=1; // request no options
-        sendPppFrame();
+        ppp.lcp->code=2; // ack all of them
+        sendPppFrame(); // sent before the options take effect, LCP always goes out uncompressed anyway
+        ppp.opt.accm = accm;
+        ppp.opt.pfc = pfc;
+        ppp.opt.acfc = acfc;
+        LCPsendRequest();
     }
 }
 
+/// handle a NAK or reject of our LCP configuration request by leaving the offending options out next time
+void LCPconfNakReject()
+{
+    int len = __REV16( ppp.lcp->lengthR ) - 4; // size of the option list
+    char * opt = ppp.lcp->request;
+    int i = 0;
+    while ( i < len ) {
+        int optLen = opt[i+1] & 0xff;
+        if ( optLen < 2 ) break;
+        switch ( opt[i] ) {
+            case LCP_OPT_ACCM:
+                ppp.opt.request &= ~LCP_REQ_ACCM;
+                break;
+            case LCP_OPT_PFC:
+                ppp.opt.request &= ~LCP_REQ_PFC;
+                break;
+            case LCP_OPT_ACFC:
+                ppp.opt.request &= ~LCP_REQ_ACFC;
+                break;
+            default:
+                break;
+        }
+        i += optLen;
+    }
+    ppp.lcp->identifier++; // this is a new request
+    LCPsendRequest();
+}
+
 /// handle LCP end (disconnect) packets by acknowledging them and by setting ppp.online to false
 void LCPend()
 {
     ppp.lcp->code=6; // end
     sendPppFrame(); // acknowledge
-    ppp.online=0; // start hunting for connect string again
-    pppInitStruct(); // flush the receive buffer
+    pppSessionReset(); // start hunting for connect string again
 }
 
 /// process incoming LCP packets
@@ -671,6 +1851,10 @@ void LCPframe()
         case 1:
             LCPconfReq();
             break; // config request
+        case 3:
+        case 4:
+            LCPconfNakReject();
+            break; // they NAKed or rejected some of our options
         case 5:
             LCPend();
             break; // end connection
@@ -680,6 +1864,7 @@ void LCPframe()
 }
 
 /// determine the packet type (IP, IPCP or LCP) of incoming packets
+/// compressed address/control and protocol fields were already expanded by hdlcRxByte()
 void determinePacketType()
 {
     if ( ppp.ppp->address != 0xff ) {
@@ -699,76 +1884,115 @@ void determinePacketType()
         case 0x0021:
             IPframe();
             break;  // IP itself
+        case 0x002d:
+            vjCompressedTcp();
+            break;  // VJ compressed TCP/IP
+        case 0x002f:
+            vjUncompressedTcp();
+            break;  // VJ uncompressed TCP/IP
         default:
             break;
     }
 }
 
-/// PPP serial port receive interrupt handler.
-/// Check for available characters from the PC and read them into our own circular serial receive buffer at ppp.rx.buf.
-/// Also, if we are offline and a 0x7e frame start character is seen, we go online immediately
+/// PPP serial port receive callback.
+/// Only moves the available characters from the PC into the ppp.rx queue and wakes up the ppp task,
+/// so a slow response never holds up reception
 void pppReceiveHandler()
 {
-    char ch;
     uint16_t count;
 
     while (1) {
-    	Serial_Read(pc, (uint8_t*)&ch, 1, &count);
+        unsigned int hd = ppp.rx.head;
+        unsigned int room = (ppp.rx.tail - hd - 1) & (RXBUFLEN-1); // free bytes in the queue, one slot always stays empty
+        if ( room == 0 ) { // the ppp task is too far behind, count what we have to throw away
+            char scratch[32];
+            Serial_Read(pc, (uint8_t*)scratch, sizeof(scratch), &count);
+            if (count < 1) {
+                break;
+            }
+            ppp.rx.drops += count;
+            continue;
+        }
+        unsigned int run = RXBUFLEN - hd; // the free space is contiguous up to the end of the buffer, then it wraps
+        if (run > room) run = room;
+        Serial_Read(pc, (uint8_t*)ppp.rx.buf + hd, run, &count); // read straight into our receive buffer
+        if (count < 1) {
+            break;
+        }
+        __DMB(); // the bytes must be in the buffer before the task can see the new head
+        ppp.rx.head = (hd+count)&(RXBUFLEN-1); // update/wrap head index
+        if (count < run) {
+            break; // that was everything the serial manager had
+        }
+    }
+    OSA_EventSet(pppEvent, PPP_EVT_RX); // wake up the ppp task
+}
 
-    	if (count < 1) {
-    		break;
-    	}
+/// number of received bytes waiting for the ppp task
+int pppRxQueueDepth()
+{
+    return (ppp.rx.head - ppp.rx.tail) & (RXBUFLEN-1);
+}
 
-        int hd = (ppp.rx.head+1)&(RXBUFLEN-1); // increment/wrap head index
-        if ( hd == ppp.rx.rtail ) {
-            return;
-        }
+/// look for the Windows Dialup Networking "Direct Connection Between Two Computers" connect string, one character at a time.
+/// when it is complete we answer it and go online
+void pppConnectMatch(int ch)
+{
+    const static char connect[] = "CLIENT";
+    if (ch == connect[ppp.rx.match]) ppp.rx.match++;
+    else ppp.rx.match = (ch == connect[0]); // no letter repeats in it, so a mismatch can only restart at its first letter
+    if (connect[ppp.rx.match] == 0) {
+        // respond with Windows Dialup networking expected "Direct Connection Between Two Computers" response string
+        Serial_Print(pc, "CLIENTSERVER", gNoBlock_d);
+        ppp.rx.match = 0;
+        ppp.online = 1; // we are connected
+        OSA_EventSet(pppEvent, PPP_EVT_ONLINE);
+    }
+}
 
-        ppp.rx.buf[ppp.rx.head] = ch; // insert in our receive buffer
+/// run everything the serial callback queued through the hdlc decoder and the protocol stack
+void pppRxDrain()
+{
+    int depth = pppRxQueueDepth();
+    if (depth > ppp.rx.maxDepth) ppp.rx.maxDepth = depth;
+    while ( ppp.rx.tail != ppp.rx.head ) {
+        __DMB(); // read the byte only after we saw the head that covers it
+        int ch = ppp.rx.buf[ppp.rx.tail] & 0xff;
+        ppp.rx.tail = (ppp.rx.tail+1)&(RXBUFLEN-1); // the slot is free for the serial callback again
         if ( ppp.online == 0 ) {
-            if (ch == 0x7E) {
-                ppp.online = 1;
+            if (ch != 0x7E) {
+                pppConnectMatch(ch);
+                continue;
             }
+            ppp.online = 1; // a frame start, the peer talks ppp straight away
+            OSA_EventSet(pppEvent, PPP_EVT_ONLINE);
         }
-        ppp.rx.head = hd; // update head pointer
-        ppp.rx.buflevel++;
-    }
-
-    bool_t hasData;
-    do {
-    	hasData = false;
-    	if ( ppp.rx.head != ppp.rx.tail ) {
-            	hasData = true;
-                int oldTail = ppp.rx.tail; // remember where the character is located in the buffer
-                int rx = pc_getBuf(); // get the character
-                if (rx==FRAME_7E) {
-                    if (ppp.firstFrame) { // is this the start of the first frame start
-                        ppp.rx.rtail = ppp.rx.tail; // update real-time tail with the virtual tail
-                        ppp.hdlc.frameStartIndex = ppp.rx.tail; // remember where first frame started
-                        ppp.firstFrame=0; // clear first frame flag
-                    }  else {
-                        ppp.hdlc.frameEndIndex=oldTail; // mark the frame end character
-                        processPPPFrame(ppp.hdlc.frameStartIndex, ppp.hdlc.frameEndIndex); // process the frame
-                        ppp.rx.rtail = ppp.rx.tail; // update real-time tail with the virtual tail
-                        ppp.hdlc.frameStartIndex = ppp.rx.tail; // remember where next frame started
-                        hasData = false;
-                    }
-                }
-            }
-    } while (hasData);
+        hdlcRxByte(ch); // unstuff, check and store the character in ppp.pkt.buf
+    }
 }
 
-/// Wait for a dial-up modem connect command ("CLIENT") from the host PC, if found, we set ppp.online to true, which will start the IP packet scanner.
+/// the ppp task: all protocol processing happens here, not in the serial callback.
+/// it also wakes up every PPP_POLL_MS for the tcp retransmissions
+void pppTask(osaTaskParam_t argument)
+{
+    osaEventFlags_t flags;
+    while (1) {
+        (void)OSA_EventWait(pppEvent, PPP_EVT_RX, FALSE, PPP_POLL_MS, &flags);
+        pppRxDrain();
+        tcpPoll(); // retransmit what needs to go again
+    }
+}
+
+OSA_TASK_DEFINE(pppTask, PPP_TASK_PRIORITY, 1, PPP_TASK_STACK_SIZE, FALSE);
+
+/// Wait for a dial-up modem connect command ("CLIENT") or the first frame from the host PC.
+/// The ppp task matches the connect string as the characters arrive, we sleep until it sets ppp.online
 void waitForPcConnectString()
 {
-    while(ppp.online == 0) {
-        // search for Windows Dialup Networking "Direct Connection Between Two Computers" expected connect string
-        char * found1 = strstr( (char *)ppp.rx.buf, "CLIENT" );
-        if (found1 != NULL) {
-            // respond with Windows Dialup networking expected "Direct Connection Between Two Computers" response string
-            Serial_Print(pc, "CLIENTSERVER", gNoBlock_d);
-            ppp.online=1; // we are connected - set flag so we stop looking for the connect string
-        }
+    osaEventFlags_t flags;
+    while (ppp.online == 0) {
+        (void)OSA_EventWait(pppEvent, PPP_EVT_ONLINE, FALSE, osaWaitForever_c, &flags); // the ppp task sets it
     }
 }
 
@@ -777,5 +2001,7 @@ void initializePpp(uint8_t serial)
 {
 	pc = serial;
     pppInitStruct(); // initialize all the variables/properties/buffers
+    pppEvent = OSA_EventCreate(TRUE);
+    OSA_TaskCreate(OSA_TASK(pppTask), NULL);
     Serial_Print(pc, "Initialized PPP", gAllowToBlock_d);
 }
@@ -9,6 +9,9 @@ void waitForPcConnectString();
 void waitForPppFrame();
 void determinePacketType();
 void sendUdpData();
+void tcpPoll();
+void pppReceiveHandler();
+int pppRxQueueDepth();
 
 /// PPP header
 typedef struct { // [ff 03 00 21]
@@ -118,6 +121,61 @@ typedef struct {
     char data [0]; // data area
 } icmpHeaderType;
 
+/// A file the web server serves from flash, see web/mkassets.py
+typedef struct {
+    const char * path; // url path
+    const char * type; // content type
+    const char * data;
+    int len;
+    const char * gz; // the same data gzip compressed
+    int gzLen;
+    const char * etag; // quoted entity tags of the two variants
+    const char * gzEtag;
+#define WEB_SUM_BLOCK 64
+    const unsigned short * sum; // ones' complement sums of every whole WEB_SUM_BLOCK bytes of data, for the tcp checksum
+    const unsigned short * gzSum; // and of gz
+} webAssetType;
+
+/// A piece of a frame for sendPppFrameSegments
+typedef struct {
+    const char * data;
+    int len;
+} txSegType;
+
+/// TCP connection slot.
+typedef struct {
+#define TCP_FREE    0 // slot unused
+#define TCP_OPEN    1 // established, requests are answered
+#define TCP_CLOSING 2 // we sent our FIN
+    int state;
+    int finRcvd; // they closed their side
+    unsigned int remoteIpR; // byte reversed, as in the ip header
+    unsigned int localIpR;  // byte reversed, the address they connected to
+    unsigned int remotePortR : 16; // byte reversed
+    unsigned int localPortR  : 16; // byte reversed
+    unsigned int sndUna; // oldest sequence number they haven't acked
+    unsigned int sndNxt; // next sequence number we send
+    unsigned int rcvNxt; // next sequence number we expect from them
+    int sndWnd; // window they advertised
+    int mss; // largest segment they accept
+    unsigned int lastActive; // time of the last segment in ms, for the idle timeout
+    int ws; // upgraded to a websocket
+    unsigned int wsPending; // one bit per led whose new state we still have to push to the websocket client
+    struct {
+#define TCP_HDR_BUFLEN 256
+        char hdr[TCP_HDR_BUFLEN]; // response header, built in ram
+        int hdrLen;
+        const char * body; // response body, sent from where it is (usually flash)
+        const unsigned short * bodySum; // its block sums (see webAssetType), NULL if it has none
+        int bodyLen;
+        int len; // hdrLen + bodyLen
+        int fin; // close the connection after the response
+        unsigned int seq; // sequence number of the first header byte
+        unsigned int sentTime; // time the last segment went out, for the retransmission timeout
+        int retries; // retransmissions since the last progress
+    } out; // retransmission buffer, kept until the peer acks it
+} tcpConnType;
+
 /// Structure to manage all ppp variables.
 typedef struct pppType {
     union {
@@ -141,33 +199,141 @@ typedef struct pppType {
     int online; // we hunt for a PPP connection if this is zero
     int hostIP; // ip address of host
     int fcs; // PPP "frame check sequence" - a 16-bit HDLC-like checksum used in all PPP frames
-    int ledState; // state of LED1
+    int ledState; // one bit per led we toggle on the radio nodes
     int responseCounter;
     int firstFrame; // cleared after first frame
     unsigned int sum; // a checksum used in headers
     struct {
 #define RXBUFLEN (1<<11)
-        // the serial port receive buffer and packet buffer, size is RXBUFLEN (currently 2048 bytes)
+        // single producer single consumer byte queue from the serial callback to the ppp task, size is RXBUFLEN (currently 2048 bytes).
+        // only the serial callback moves head and only the ppp task moves tail, so neither needs a lock
         char buf[RXBUFLEN]; // RXBUFLEN MUST be a power of two because we use & operator for fast wrap-around in ring buffer
-        volatile int head; // declared volatile so user code knows this variable changes in the interrupt handler
-        int tail;
-        int rtail;
-        int buflevel;
+        volatile unsigned int head; // declared volatile so the ppp task sees the serial callback change it
+        volatile unsigned int tail;
+        unsigned int drops; // bytes lost because the queue was full
+        int maxDepth; // most bytes ever waiting in the queue
+        int match; // characters of the connect string seen so far while offline
     } rx; // serial port objects
+#ifndef PPP_TASK_PRIORITY
+#define PPP_TASK_PRIORITY 3 // below the genfsk link layer task
+#endif
+#ifndef PPP_TASK_STACK_SIZE
+#define PPP_TASK_STACK_SIZE 1280
+#endif
+#define PPP_POLL_MS 100 // the ppp task checks the tcp retransmission timers this often
     struct {
-        int len; // number of bytes in buffer
+        int len; // number of bytes in buffer (also the write index of the hdlc decoder)
         int crc; // PPP CRC (frame check)
 #define PPP_max_size 1600
         // we are assuming 100 bytes more than MTU size of 1500
         char buf[PPP_max_size]; // send and receive buffer large enough for largest IP packet
     } pkt; // ppp buffer objects
     struct {
-        int frameStartIndex; // frame start marker
-        int frameEndIndex; // frame end marker
-    } hdlc; // hdlc frame objects
+#define PPP_TX_BUFLEN (2*PPP_max_size+2)
+        // worst case size of an escaped frame: every byte stuffed plus the two flags
+        char buf[2][PPP_TX_BUFLEN]; // double buffer: one is filled while the serial driver sends the other
+        volatile int busy[2]; // set while the serial driver is still sending from buf[i]
+        int fill; // index of the buffer the next frame is built in
+    } tx; // hdlc transmit objects
+    struct {
+        int escape; // set when the previous character was the 0x7d escape
+        int overrun; // set when the frame being decoded did not fit in ppp.pkt.buf
+    } hdlc; // hdlc decoder objects
     struct {
         unsigned int ident; // our IP ident value (outgoing frame count)
     } ipData; // ip related object
+    struct {
+#define LCP_OPT_ACCM 2 // async control character map
+#define LCP_OPT_PFC  7 // protocol field compression
+#define LCP_OPT_ACFC 8 // address and control field compression
+#define LCP_REQ_ACCM (1<<0)
+#define LCP_REQ_PFC  (1<<1)
+#define LCP_REQ_ACFC (1<<2)
+#define LCP_REQ_ALL  (LCP_REQ_ACCM|LCP_REQ_PFC|LCP_REQ_ACFC)
+        unsigned int accm; // control characters the peer wants escaped (bit n set: escape character n)
+        int pfc; // peer accepts a one-byte protocol field
+        int acfc; // peer accepts frames without ff 03
+        int request; // LCP_REQ_ flags of the options we still ask the peer for
+    } opt; // negotiated lcp options
+    int localIP; // our ip address as suggested by the peer in an IPCP NAK, 0 if none
+#ifndef TCP_CONNECTIONS
+#define TCP_CONNECTIONS 4 // number of simultaneous tcp connections
+#endif
+#ifndef TCP_IDLE_MS
+#define TCP_IDLE_MS 30000 // connections without traffic for this long are dropped
+#endif
+#define TCP_DEFAULT_MSS 536 // assumed when the SYN has no MSS option
+#define TCP_MAX_MSS 1460 // 1500 byte MTU minus ip and tcp headers
+#ifndef TCP_RTO_MS
+#define TCP_RTO_MS 1000 // first retransmission timeout, doubles on every retry
+#endif
+#ifndef TCP_MAX_RETRIES
+#define TCP_MAX_RETRIES 5 // then we give up on the connection
+#endif
+    tcpConnType conn[TCP_CONNECTIONS]; // tcp connection table
+    struct {
+#define IPCP_OPT_VJ 2 // ip compression protocol
+#define IPCP_OPT_IP 3 // ip address
+#define VJ_SLOTS 4 // connection slots we keep in each direction
+#define VJ_MAX_HDR 128 // largest ip+tcp header a slot can hold
+#define VJ_NEW_C 0x40 // RFC 1144 change mask bits
+#define VJ_NEW_I 0x20
+#define VJ_PUSH  0x10
+#define VJ_NEW_S 0x08
+#define VJ_NEW_A 0x04
+#define VJ_NEW_W 0x02
+#define VJ_NEW_U 0x01
+#define VJ_SPECIAL_I (VJ_NEW_S|VJ_NEW_W|VJ_NEW_U) // echoed interactive traffic
+#define VJ_SPECIAL_D (VJ_NEW_S|VJ_NEW_A|VJ_NEW_W|VJ_NEW_U) // unidirectional data
+#define VJ_SPECIALS  0x0f
+        int request; // we still ask the peer to compress what it sends us
+        int txSlots; // slots we may use towards the peer, 0 if it didn't ask for compression
+        int txCompSlot; // peer accepts packets without a slot id
+        int txLast; // slot of the last packet we sent
+        int txNext; // slot to take over for the next new connection
+        int rxLast; // slot of the last packet we received
+        int rxToss; // drop compressed packets until an uncompressed one resyncs us
+        unsigned int saved; // header bytes saved on the link, both directions
+        struct {
+            int len; // header length, 0 if the slot is unused
+            char hdr[VJ_MAX_HDR]; // last ip+tcp header of this connection
+        } tx[VJ_SLOTS], rx[VJ_SLOTS];
+    } vj; // van jacobson tcp/ip header compression objects
+    struct {
+#define COAP_PORT 5683
+#ifndef COAP_OBSERVERS
+#define COAP_OBSERVERS 4 // number of clients that can observe a led
+#endif
+#define COAP_CON 0 // message types
+#define COAP_NON 1
+#define COAP_ACK 2
+#define COAP_RST 3
+#define COAP_GET 0x01 // request codes
+#define COAP_PUT 0x03
+#define COAP_CHANGED     0x44 // response codes: class << 5 | detail
+#define COAP_CONTENT     0x45
+#define COAP_BAD_REQUEST 0x80
+#define COAP_BAD_OPTION  0x82
+#define COAP_NOT_FOUND   0x84
+#define COAP_NOT_ALLOWED 0x85
+#define COAP_OPT_OBSERVE 6
+#define COAP_OPT_URI_PATH 11
+#define COAP_OPT_FORMAT 12
+#define COAP_FORMAT_TEXT 0
+#define COAP_FORMAT_LINK 40
+        unsigned int mid; // message id of the next message we start
+        unsigned int seq; // observe sequence number, counts the led changes
+        struct {
+            int used;
+            int led; // the led resource observed
+            unsigned int localIp, ip; // the addresses and ports the registration came in on
+            unsigned int localPort, port;
+            int tkl; // token length
+            char token[8];
+            unsigned int mid; // message id of the last notification, a reset with it ends the observation
+            int pending; // the led changed, a notification is due
+        } obs[COAP_OBSERVERS];
+    } coap; // coap server objects
 } pppType;
 
 #endif /* PPPWEBSERVER_H */
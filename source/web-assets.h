@@ -0,0 +1,62 @@
+// Generated by web/mkassets.py from the files in source/web - do not edit
+
+#ifndef WEBASSETS_H
+#define WEBASSETS_H
+
+// index.html: 708 bytes, 429 gzipped
+const static char webAsset0[] =
+    "<!DOCTYPE html><html><head><title>Blinky Over Radio</title><scri"
+    "pt>var w=new WebSocket('ws://'+location.host+'/ws');w.onmessage="
+    "function(e){for(var i=0;i+1<e.data.length;i+=2)document.getEleme"
+    "ntById(e.data[i]).innerHTML=e.data[i+1]=='1'?'on':'off';};functi"
+    "on t(c){if(w.readyState==1)w.send(c);else window.location.href='"
+    "/'+c;}</script><body style=\"font-family: sans-serif; font-size:2"
+    "5px; color:#807070\"><h1>Blinky Over Radio</h1><form><input type="
+    "\"button\" value=\"Toggle LED1\" onclick=\"t('a')\"/> <span id=\"a\">?</"
+    "span><br><input type=\"button\" value=\"Toggle LED2\" onclick=\"t('b'"
+    ")\"/> <span id=\"b\">?</span><br><input type=\"button\" value=\"Toggle"
+    " LED3\" onclick=\"t('c')\"/> <span id=\"c\">?</span></form></body></h"
+    "tml>";
+const static unsigned char webAsset0Gz[] = {
+    0x1f,0x8b,0x08,0x00,0x00,0x00,0x00,0x00,0x02,0x03,0x9d,0x92,0x6d,0x6b,0xdb,0x30,
+    0x10,0xc7,0xbf,0x8a,0xe6,0xbe,0x90,0x4d,0xa8,0x5d,0x67,0x8c,0x0d,0x5b,0x72,0xa1,
+    0x6b,0x60,0x83,0x8e,0x8e,0x35,0x30,0xca,0xe8,0x0b,0x59,0x3e,0x3b,0x22,0xb2,0x64,
+    0xa4,0x73,0x3c,0xb7,0xf4,0xbb,0x4f,0x69,0x5a,0xb6,0x96,0xbe,0x28,0x43,0x20,0xe9,
+    0x1e,0xf8,0xdd,0xdd,0x5f,0x62,0xef,0xce,0x2f,0x3f,0xaf,0xaf,0xbf,0xaf,0xc8,0x06,
+    0x7b,0x5d,0xb1,0xc7,0x1d,0x44,0x53,0x31,0x54,0xa8,0xa1,0x3a,0xd3,0xca,0x6c,0x67,
+    0x72,0xb9,0x03,0x47,0x7e,0x88,0x46,0x59,0x96,0x1d,0x02,0xcc,0x4b,0xa7,0x06,0xac,
+    0x76,0xc2,0x91,0x89,0x1b,0x98,0xc8,0x4f,0xa8,0xaf,0xac,0xdc,0x02,0xc6,0x74,0xf2,
+    0x45,0x96,0xd1,0x85,0xb6,0x52,0xa0,0xb2,0x26,0xdd,0x58,0x8f,0x0b,0x9a,0x4d,0x9e,
+    0x26,0xe5,0x94,0x5a,0xd3,0x83,0xf7,0xa2,0x03,0xde,0x8e,0x46,0xee,0x13,0x62,0x48,
+    0xee,0x5a,0xeb,0xe2,0x3d,0x4c,0xf1,0x93,0x52,0x2d,0x72,0x06,0x69,0x23,0x50,0xa4,
+    0x1a,0x4c,0x87,0x9b,0xe0,0xe1,0xcb,0xa4,0xb1,0x72,0xec,0xc1,0x60,0xda,0x01,0xae,
+    0x34,0xec,0xaf,0x67,0xf3,0xd7,0x26,0x3e,0xa4,0xfe,0x52,0x37,0x49,0xaa,0x8c,0x01,
+    0xf7,0x65,0xfd,0xed,0x82,0x3f,0x39,0x17,0xf9,0x0d,0xe7,0x34,0xa7,0xa7,0xd4,0x1a,
+    0x5a,0x50,0xdb,0xb6,0xb4,0xbc,0x2f,0x9f,0x2a,0x13,0x8c,0x65,0x72,0xa7,0xda,0x78,
+    0x4a,0x5d,0x18,0x7b,0xbe,0x42,0x81,0xc0,0x79,0x9e,0x4c,0xa9,0x07,0xd3,0x84,0x60,
+    0x09,0xda,0x03,0x99,0x94,0x69,0xec,0x94,0xfe,0x9d,0xc8,0x41,0xcb,0x69,0x98,0x51,
+    0x96,0xf7,0x2c,0x7b,0xd4,0x82,0xd5,0xb6,0x99,0x89,0xc7,0x59,0x03,0x8f,0x5a,0x6b,
+    0xf0,0xb8,0x15,0xbd,0xd2,0x73,0x41,0xbc,0x30,0xfe,0xd8,0x83,0x53,0x6d,0x49,0x1e,
+    0x02,0x5e,0xdd,0x42,0xb1,0xfc,0x30,0xfc,0x2e,0x89,0xb4,0xda,0xba,0xe2,0xe8,0xd3,
+    0xc9,0xc7,0xb0,0xa2,0x20,0x7f,0xfe,0x9a,0xea,0xc1,0xcb,0x82,0x44,0x7d,0xc5,0x94,
+    0x19,0x46,0x24,0x38,0x0f,0xa1,0x48,0x3d,0x22,0x5a,0x13,0x91,0x9d,0xd0,0x63,0x30,
+    0xd7,0xb6,0xeb,0x34,0x90,0x8b,0xd5,0x79,0x1e,0x11,0x6b,0xa4,0x56,0x72,0xcb,0xa3,
+    0xf0,0x20,0x82,0x26,0x51,0x56,0x11,0xe6,0x07,0x61,0x88,0x6a,0x78,0x24,0xa2,0xea,
+    0x34,0xf4,0x1d,0xcc,0xd0,0xb5,0x7b,0x23,0x74,0xf9,0x1c,0x5a,0xbf,0x84,0xd6,0xff,
+    0x03,0x7d,0xff,0x1c,0x2a,0x5f,0x42,0xe5,0x3f,0xd0,0xec,0xa0,0x40,0xb6,0xd7,0x39,
+    0x1c,0x0f,0xdf,0xf5,0x0f,0xa5,0x9e,0xe7,0x14,0xc4,0x02,0x00,0x00,
+};
+const static unsigned short webAsset0Sum[] = {
+    0x5011,0xb394,0xe4ab,0x7293,0x8c0d,0x1f8c,0xfce3,0xc999,
+    0x397a,0x0931,0x867b,
+};
+const static unsigned short webAsset0GzSum[] = {
+    0x23b3,0x65f4,0x85f2,0xeb4e,0xeffe,0x7b3f,
+};
+
+const static webAssetType webAssets[] = {
+    { "/index.html", "text/html; charset=us-ascii", webAsset0, sizeof(webAsset0)-1, (const char *)webAsset0Gz, sizeof(webAsset0Gz), "\"4e64cc0f1c7ed54b\"", "\"4e64cc0f1c7ed54b-gz\"", webAsset0Sum, webAsset0GzSum },
+};
+#define WEB_ASSETS (sizeof(webAssets)/sizeof(webAssets[0]))
+
+#endif /* WEBASSETS_H */
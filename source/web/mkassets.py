@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+# Generates ../web-assets.h, the read-only table of the files the web server serves.
+# Every asset is stored twice in flash: as is, and gzip compressed for clients that send "Accept-Encoding: gzip".
+# Run it after changing a file in this directory:  python3 mkassets.py
+# Line breaks in html files are dropped, like the string continuations the page used to be written with.
+# Each variant gets an ETag from a hash of its bytes, so it only changes when the content does.
+# The ones' complement sums of every 64 byte block (WEB_SUM_BLOCK) let the tcp checksum skip most of the body.
+
+import gzip
+import hashlib
+import os
+
+# url path, file, content type
+ASSETS = [
+    ("/index.html", "index.html", "text/html; charset=us-ascii"),
+]
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+OUT = os.path.join(HERE, "..", "web-assets.h")
+
+
+def cString(data):
+    lines = []
+    for i in range(0, len(data), 64):
+        part = data[i:i+64]
+        text = "".join("\\" + chr(c) if chr(c) in '"\\' else chr(c) if 32 <= c < 127 else "\\%03o" % c for c in part)
+        lines.append('"%s"' % text)
+    return "\n    ".join(lines) if lines else '""'
+
+
+def cBytes(data):
+    lines = []
+    for i in range(0, len(data), 16):
+        lines.append(",".join("0x%02x" % c for c in data[i:i+16]) + ",")
+    return "\n    ".join(lines)
+
+
+BLOCK = 64  # WEB_SUM_BLOCK in ppp-webserver.h
+
+
+def blockSums(data):
+    sums = []
+    for i in range(0, len(data) - BLOCK + 1, BLOCK):
+        s = 0
+        for j in range(i, i + BLOCK, 2):
+            s += (data[j] << 8) | data[j + 1]
+        while s >> 16:
+            s = (s & 0xffff) + (s >> 16)
+        sums.append(s)
+    return sums
+
+
+def cShorts(sums):
+    lines = []
+    for i in range(0, len(sums), 8):
+        lines.append(",".join("0x%04x" % s for s in sums[i:i+8]) + ",")
+    return "\n    ".join(lines) if lines else "0"
+
+
+def main():
+    out = []
+    out.append("// Generated by web/mkassets.py from the files in source/web - do not edit")
+    out.append("")
+    out.append("#ifndef WEBASSETS_H")
+    out.append("#define WEBASSETS_H")
+    out.append("")
+    table = []
+    for n, (path, name, ctype) in enumerate(ASSETS):
+        data = open(os.path.join(HERE, name), "rb").read()
+        if name.endswith(".html"):
+            data = data.replace(b"\r", b"").replace(b"\n", b"")
+        gz = gzip.compress(data, 9, mtime=0)
+        etag = hashlib.sha1(data).hexdigest()[:16]
+        out.append("// %s: %d bytes, %d gzipped" % (name, len(data), len(gz)))
+        out.append("const static char webAsset%d[] =\n    %s;" % (n, cString(data)))
+        out.append("const static unsigned char webAsset%dGz[] = {\n    %s\n};" % (n, cBytes(gz)))
+        out.append("const static unsigned short webAsset%dSum[] = {\n    %s\n};" % (n, cShorts(blockSums(data))))
+        out.append("const static unsigned short webAsset%dGzSum[] = {\n    %s\n};" % (n, cShorts(blockSums(gz))))
+        out.append("")
+        table.append('    { "%s", "%s", webAsset%d, sizeof(webAsset%d)-1, (const char *)webAsset%dGz, sizeof(webAsset%dGz), "\\"%s\\"", "\\"%s-gz\\"", webAsset%dSum, webAsset%dGzSum },'
+                     % (path, ctype, n, n, n, n, etag, etag, n, n))
+    out.append("const static webAssetType webAssets[] = {")
+    out.extend(table)
+    out.append("};")
+    out.append("#define WEB_ASSETS (sizeof(webAssets)/sizeof(webAssets[0]))")
+    out.append("")
+    out.append("#endif /* WEBASSETS_H */")
+    open(OUT, "w").write("\n".join(out) + "\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,116 @@
+// Host equivalence test and benchmark of the word-at-a-time onesSum()/dataCheckSum() against the
+// byte pair loop dataCheckSum() used before. Random lengths and start alignments, odd tails and
+// buffers of 0xff that make every carry fold count.
+// Build and run from the repository root:
+//   gcc -O2 -Itest/stubs -Isource -Igenfsk -o checksum-test test/checksum-test.c source/sha1.c && ./checksum-test
+
+#include "../source/ppp-webserver.c"
+#include "host.h"
+#include <time.h>
+
+/// the old dataCheckSum: byte pairs, and a zero written after an odd last byte.
+/// chars are unsigned on the cortex-m, so the bytes are read as unsigned here too
+unsigned int oldDataCheckSum(unsigned char * ptr, int len, unsigned int * sum)
+{
+    unsigned int i,hi,lo;
+    unsigned char placeHolder = 0;
+    if (len&1) {
+        placeHolder = ptr[len];
+        ptr[len]=0;
+    }
+    i=0;
+    while ( (int)i<len ) {
+        hi = ptr[i++];
+        lo = ptr[i++];
+        *sum = *sum + ((hi<<8)|lo);
+    }
+    if (len&1) {
+        ptr[len] = placeHolder;
+    }
+    *sum = (*sum & 0xffff) + (*sum>>16);
+    *sum = (*sum & 0xffff) + (*sum>>16);
+    return ~*sum;
+}
+
+double seconds()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec*1e-9;
+}
+
+#define MAXLEN 4096
+static uint32_t space[(MAXLEN+64)/4]; // word aligned, the tests pick the alignment inside it
+static unsigned char copy[MAXLEN+64];
+
+/// checksum len bytes at offset with both routines, continuing from the same running sum
+void compare(int offset, int len, unsigned int start)
+{
+    char * buf = (char *)space + offset;
+    memcpy(copy, buf, len+1);
+    unsigned int oldSum = start;
+    unsigned int want = oldDataCheckSum(copy, len, &oldSum);
+    ppp.sum = start;
+    unsigned int got = dataCheckSum(buf, len, 0);
+    CHECK(got == want, "offset %d len %d from %04x: %08x, old loop %08x", offset, len, start, got, want);
+    CHECK(memcmp(copy, buf, len+1) == 0, "offset %d len %d: the buffer was written", offset, len);
+}
+
+int main()
+{
+    unsigned char * bytes = (unsigned char *)space;
+    srand(1);
+
+    // random data, every alignment, every short length and random long ones
+    for (int i=0; i<(int)sizeof(space); i++) bytes[i] = rand();
+    for (int offset=0; offset<8; offset++) {
+        for (int len=0; len<64; len++) compare(offset, len, 0);
+        for (int n=0; n<500; n++) compare(offset, rand() % (MAXLEN-8), rand() & 0xffff);
+    }
+
+    // all ones: the accumulator and the folds carry all the time
+    memset(bytes, 0xff, sizeof(space));
+    for (int offset=0; offset<4; offset++) {
+        for (int len=0; len<MAXLEN-8; len+=13) compare(offset, len, 0xffff);
+    }
+    // and all zeros, ones' complement has two zeros and both routines have to agree on which
+    memset(bytes, 0, sizeof(space));
+    for (int offset=0; offset<4; offset++) {
+        for (int len=0; len<100; len+=3) compare(offset, len, 0);
+    }
+
+    // a sum split at any point, odd or even, adds up to the sum of the whole
+    for (int i=0; i<(int)sizeof(space); i++) bytes[i] = rand();
+    for (int n=0; n<2000; n++) {
+        int offset = rand() % 8;
+        int len = rand() % 2000;
+        int split = len ? rand() % len : 0;
+        const char * buf = (const char *)space + offset;
+        unsigned int whole = onesSum(buf, len);
+        unsigned int parts = onesSumAdd(onesSum(buf, split), split, onesSum(buf+split, len-split));
+        CHECK(whole%0xffff == parts%0xffff, "offset %d len %d split %d: %04x, parts %04x", offset, len, split, whole, parts);
+    }
+
+    // benchmark over ip packet sized buffers, aligned and at an odd address
+    int len = 1500;
+    int rounds = 100000;
+    volatile unsigned int sink;
+    for (int offset=0; offset<2; offset++) {
+        unsigned char * buf = (unsigned char *)space + offset;
+        double t0 = seconds();
+        for (int r=0; r<rounds; r++) {
+            unsigned int sum = 0;
+            sink = oldDataCheckSum(buf, len, &sum);
+        }
+        double t1 = seconds();
+        for (int r=0; r<rounds; r++) sink = dataCheckSum((char *)buf, len, 1);
+        double t2 = seconds();
+        double total = (double)rounds*len;
+        printf("%s start: byte pairs %.3f ns/byte, words %.3f ns/byte, %.1fx faster\n", offset ? "odd" : "aligned",
+               (t1-t0)*1e9/total, (t2-t1)*1e9/total, (t1-t0)/(t2-t1));
+    }
+    (void)sink;
+
+    printf(hostFailures ? "%d checks FAILED\n" : "all checks passed\n", hostFailures);
+    return hostFailures != 0;
+}
@@ -0,0 +1,88 @@
+// Host test and micro-benchmark of the table-driven PPP FCS against the bit-at-a-time loop it replaced.
+// Build and run from the repository root:
+//   gcc -O2 -Itest/stubs -Isource -Igenfsk -o fcs-test test/fcs-test.c source/sha1.c && ./fcs-test
+
+#include "../source/ppp-webserver.c"
+#include "host.h"
+#include <time.h>
+
+/// the bitwise crc-16 fcsDo used before the table, RFC 1662 polynomial 0x8408
+unsigned int fcsBitwise(unsigned int fcs, int x)
+{
+    for (int i=0; i<8; i++) {
+        fcs=((fcs&1)^(x&1))?(fcs>>1)^0x8408:fcs>>1;
+        x>>=1;
+    }
+    return fcs;
+}
+
+double seconds()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec*1e-9;
+}
+
+static char data[1<<16];
+
+int main()
+{
+    // every table entry is the bitwise crc of its index
+    for (int i=0; i<256; i++) {
+        CHECK(fcsTable[i] == fcsBitwise(0, i), "fcsTable[%d] is %04x, bitwise %04x", i, fcsTable[i], fcsBitwise(0, i));
+    }
+
+    // the running fcs agrees for any byte after any previous state
+    for (unsigned int state=0; state<0x10000; state+=0x101) {
+        for (int x=0; x<256; x++) {
+            ppp.fcs = state;
+            fcsDo(x);
+            CHECK(ppp.fcs == fcsBitwise(state, x), "fcsDo(%02x) from %04x", x, state);
+        }
+    }
+
+    // RFC 1662 check value: a frame followed by its complemented fcs leaves the good fcs 0xf0b8
+    srand(1);
+    for (int i=0; i<(int)sizeof(data); i++) data[i] = rand();
+    for (int len=1; len<200; len++) {
+        fcsReset();
+        for (int i=0; i<len; i++) fcsDo(data[i]);
+        unsigned int fcs = ~ppp.fcs & 0xffff;
+        fcsDo(fcs & 0xff);
+        fcsDo(fcs >> 8);
+        CHECK(ppp.fcs == 0xf0b8, "good fcs after %d bytes is %04x", len, ppp.fcs);
+    }
+
+    // the transmit path runs the same table inline while it escapes the bytes
+    char out[2*sizeof(data)+8];
+    for (int len=0; len<300; len+=7) {
+        unsigned int fcs = 0xffff;
+        for (int i=0; i<len; i++) fcs = fcsBitwise(fcs, data[i] & 0xff);
+        fcsReset();
+        hdlcPutPiece(out, 0, sizeof(out), data, len, 0xffffffff);
+        CHECK(ppp.fcs == fcs, "hdlcPutPiece fcs over %d bytes is %04x, bitwise %04x", len, ppp.fcs, fcs);
+    }
+
+    // benchmark both over the same 64 KB buffer
+    int rounds = 64;
+    volatile unsigned int sink;
+    double t0 = seconds();
+    for (int r=0; r<rounds; r++) {
+        unsigned int fcs = 0xffff;
+        for (int i=0; i<(int)sizeof(data); i++) fcs = fcsBitwise(fcs, data[i]);
+        sink = fcs;
+    }
+    double t1 = seconds();
+    for (int r=0; r<rounds; r++) {
+        fcsReset();
+        for (int i=0; i<(int)sizeof(data); i++) fcsDo(data[i]);
+        sink = ppp.fcs;
+    }
+    double t2 = seconds();
+    (void)sink;
+    double bytes = (double)rounds*sizeof(data);
+    printf("bitwise %.2f ns/byte, table %.2f ns/byte, %.1fx faster\n", (t1-t0)*1e9/bytes, (t2-t1)*1e9/bytes, (t1-t0)/(t2-t1));
+
+    printf(hostFailures ? "%d checks FAILED\n" : "all checks passed\n", hostFailures);
+    return hostFailures != 0;
+}
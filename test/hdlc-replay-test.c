@@ -0,0 +1,225 @@
+// Host replay test of the receive path: HDLC byte streams go through pppReceiveHandler() and pppRxDrain()
+// into the streaming decoder, and we check which frames come out the other side.
+// The frames are ICMP pings with a sequence number, so every frame the decoder delivers is answered with
+// an echo reply we can pick out of the serial output.
+// Build and run from the repository root:
+//   gcc -O2 -Itest/stubs -Isource -Igenfsk -o hdlc-replay-test test/hdlc-replay-test.c source/sha1.c && ./hdlc-replay-test
+
+#include "../source/ppp-webserver.c"
+#include "host.h"
+
+static unsigned char stream[16384];
+static int streamLen;
+static unsigned char replyData[64][40]; // the start of the echoed data of each reply
+
+/// crc-16 of RFC 1662, bit at a time so it does not share any code with the decoder
+unsigned int crc16(const unsigned char * p, int len)
+{
+    unsigned int fcs = 0xffff;
+    while (len--) {
+        fcs ^= *p++;
+        for (int i=0; i<8; i++) fcs = (fcs&1) ? (fcs>>1)^0x8408 : fcs>>1;
+    }
+    return fcs;
+}
+
+void put(int ch)
+{
+    stream[streamLen++] = ch;
+}
+
+/// append one escaped byte, control characters are escaped like with the default ACCM
+void putEscaped(int ch)
+{
+    if ( (ch < 0x20) || (ch == 0x7d) || (ch == 0x7e) ) {
+        put(0x7d);
+        ch ^= 0x20;
+    }
+    put(ch);
+}
+
+/// a ping from the host with sequence number seq, payloadLen bytes of data starting with the bytes in fill.
+/// compressed leaves out ff 03 and the high protocol byte, like a peer that negotiated ACFC and PFC
+int pingFrame(unsigned char * f, int seq, int payloadLen, const char * fill, int compressed)
+{
+    int n=0;
+    if (!compressed) {
+        f[n++]=0xff;
+        f[n++]=0x03;
+        f[n++]=0x00;
+    }
+    f[n++]=0x21;
+    unsigned char * ip = f+n;
+    int ipLen = 20+8+payloadLen;
+    memset(ip, 0, ipLen);
+    ip[0]=0x45;
+    ip[2]=ipLen>>8;
+    ip[3]=ipLen;
+    ip[8]=64; // ttl
+    ip[9]=1; // icmp
+    ip[12]=172; ip[13]=10; ip[14]=10; ip[15]=1;
+    ip[16]=172; ip[17]=10; ip[18]=10; ip[19]=2;
+    unsigned char * icmp = ip+20;
+    icmp[0]=8; // echo request
+    icmp[6]=seq>>8;
+    icmp[7]=seq;
+    for (int i=0; i<payloadLen; i++) icmp[8+i] = fill[i % strlen(fill)];
+    n += ipLen;
+    return n;
+}
+
+/// append a frame with its fcs, without the flags. badFcs corrupts the fcs
+void putFrame(const unsigned char * f, int len, int badFcs)
+{
+    unsigned int fcs = ~crc16(f, len) & 0xffff;
+    if (badFcs) fcs ^= 0x0100;
+    for (int i=0; i<len; i++) putEscaped(f[i]);
+    putEscaped(fcs & 0xff);
+    putEscaped(fcs >> 8);
+}
+
+void putPing(int seq, int payloadLen, const char * fill, int compressed, int badFcs)
+{
+    unsigned char f[2048];
+    putFrame(f, pingFrame(f, seq, payloadLen, fill, compressed), badFcs);
+}
+
+/// run the stream through the receive path, chunk bytes per serial callback, then collect the
+/// sequence numbers of the echo replies. Returns how many replies there were
+int replay(int chunk, int * seqs, int max)
+{
+    pppInitStruct();
+    hostOutLen = 0;
+    for (int i=0; i<streamLen; i+=chunk) {
+        hostIn = (const char *)stream + i;
+        hostInLen = (streamLen - i < chunk) ? streamLen - i : chunk;
+        pppReceiveHandler();
+        pppRxDrain();
+    }
+
+    // unstuff what we sent back and check it too
+    static unsigned char frame[4096];
+    int n=0, escape=0, replies=0;
+    for (int i=0; i<hostOutLen; i++) {
+        int ch = hostOut[i] & 0xff;
+        if (ch == 0x7e) {
+            if (n > 0) {
+                CHECK(crc16(frame, n) == 0xf0b8, "reply with a bad fcs");
+                unsigned char * ip = frame+4;
+                if ( (n > 4+28) && (frame[3] == 0x21) && (ip[9] == 1) && (ip[20] == 0) && (replies < max) ) {
+                    memcpy(replyData[replies], ip+28, n-4-28-2 < 40 ? n-4-28-2 : 40);
+                    seqs[replies++] = (ip[26]<<8) | ip[27];
+                }
+            }
+            n=0;
+            continue;
+        }
+        if (ch == 0x7d) {
+            escape=1;
+            continue;
+        }
+        if (escape) {
+            ch ^= 0x20;
+            escape=0;
+        }
+        if (n < (int)sizeof(frame)) frame[n++] = ch;
+    }
+    return replies;
+}
+
+/// replay the stream whole, in small pieces and byte by byte, the same frames have to come out each time
+void expect(const char * name, const int * want, int wantCount)
+{
+    static const int chunks[] = { 4096, 7, 1 };
+    int failures = hostFailures;
+    for (int c=0; c<3; c++) {
+        int got[64];
+        int count = replay(chunks[c], got, 64);
+        int same = (count == wantCount);
+        for (int i=0; same && (i<count); i++) same = (got[i] == want[i]);
+        CHECK(same, "%s, %d byte reads: %d frames delivered, %d expected", name, chunks[c], count, wantCount);
+    }
+    printf("%-40s %s\n", name, hostFailures == failures ? "ok" : "FAILED");
+}
+
+int main()
+{
+    // escapes: the data is full of flag, escape and control characters
+    streamLen=0;
+    put(0x7e);
+    putPing(1, 40, "\x7e\x7d\x01\x1f\x11\x13", 0, 0);
+    put(0x7e);
+    putPing(2, 40, "\x7d\x5e\x7d\x5d", 1, 0);
+    put(0x7e);
+    { int want[] = { 1, 2 }; expect("escaped flag, escape and control bytes", want, 2); }
+
+    // the echoed data has to be the data we sent
+    {
+        int seqs[4];
+        replay(4096, seqs, 4);
+        CHECK(memcmp(replyData[0], "\x7e\x7d\x01\x1f\x11\x13\x7e\x7d", 8) == 0, "ping 1 data changed on the way");
+        CHECK(memcmp(replyData[1], "\x7d\x5e\x7d\x5d\x7d\x5e", 6) == 0, "ping 2 data changed on the way");
+    }
+
+    // back-to-back frames share one flag, extra flags in between are empty frames
+    streamLen=0;
+    put(0x7e);
+    putPing(3, 10, "a", 0, 0);
+    put(0x7e);
+    putPing(4, 10, "b", 0, 0);
+    put(0x7e);
+    put(0x7e);
+    put(0x7e);
+    putPing(5, 10, "c", 1, 0);
+    put(0x7e);
+    { int want[] = { 3, 4, 5 }; expect("shared and repeated flags", want, 3); }
+
+    // a bad fcs drops only that frame
+    streamLen=0;
+    put(0x7e);
+    putPing(6, 20, "x", 0, 0);
+    put(0x7e);
+    putPing(7, 20, "x", 0, 1);
+    put(0x7e);
+    putPing(8, 20, "x", 0, 0);
+    put(0x7e);
+    { int want[] = { 6, 8 }; expect("bad fcs", want, 2); }
+
+    // an aborted frame (escape then flag) is dropped, the flag still opens the next one
+    streamLen=0;
+    put(0x7e);
+    putPing(9, 20, "y", 0, 0);
+    put(0x7e);
+    {
+        unsigned char f[256];
+        int len = pingFrame(f, 10, 20, "y", 0);
+        for (int i=0; i<len/2; i++) putEscaped(f[i]);
+        put(0x7d);
+        put(0x7e);
+    }
+    putPing(11, 20, "y", 0, 0);
+    put(0x7e);
+    { int want[] = { 9, 11 }; expect("aborted frame", want, 2); }
+
+    // a frame too big for the packet buffer is dropped at its closing flag
+    streamLen=0;
+    put(0x7e);
+    putPing(12, PPP_max_size, "z", 0, 0);
+    put(0x7e);
+    putPing(13, 20, "z", 0, 0);
+    put(0x7e);
+    { int want[] = { 13 }; expect("oversized frame", want, 1); }
+
+    // noise before the first flag is not a frame
+    streamLen=0;
+    put('C');
+    put('L');
+    put(0x21);
+    put(0x7e);
+    putPing(14, 20, "w", 0, 0);
+    put(0x7e);
+    { int want[] = { 14 }; expect("bytes before the first flag", want, 1); }
+
+    printf(hostFailures ? "%d checks FAILED\n" : "all checks passed\n", hostFailures);
+    return hostFailures != 0;
+}
@@ -0,0 +1,53 @@
+// Host definitions for the functions ppp-webserver.c calls outside itself.
+// A test includes ../source/ppp-webserver.c and then this file, and links ../source/sha1.c.
+// Everything written to the serial port is appended to hostOut, Serial_Read hands out hostIn.
+
+#include <stdlib.h>
+
+static char hostOut[1<<16];
+static int hostOutLen;
+static const char * hostIn;
+static int hostInLen;
+static unsigned int hostNow = 1000;
+
+serialStatus_t Serial_SyncWrite(uint8_t id, uint8_t *p, uint16_t n)
+{
+    if ( hostOutLen + n <= (int)sizeof(hostOut) ) memcpy(hostOut+hostOutLen, p, n);
+    hostOutLen += n;
+    return gSerial_Success_c;
+}
+
+serialStatus_t Serial_AsyncWrite(uint8_t id, uint8_t *p, uint16_t n, pSerialCallBack_t cb, void *param)
+{
+    Serial_SyncWrite(id, p, n);
+    cb(param); // the write is done at once
+    return gSerial_Success_c;
+}
+
+serialStatus_t Serial_Read(uint8_t id, uint8_t *p, uint16_t n, uint16_t *count)
+{
+    if (n > hostInLen) n = hostInLen;
+    memcpy(p, hostIn, n);
+    hostIn += n;
+    hostInLen -= n;
+    *count = n;
+    return gSerial_Success_c;
+}
+
+serialStatus_t Serial_Print(uint8_t id, char *s, uint8_t allowToBlock) { return gSerial_Success_c; }
+osaEventId_t OSA_EventCreate(bool_t autoClear) { return (osaEventId_t)1; }
+osaStatus_t OSA_EventSet(osaEventId_t eventId, osaEventFlags_t flagsToSet) { return 0; }
+osaStatus_t OSA_EventWait(osaEventId_t eventId, osaEventFlags_t flagsToWait, bool_t waitAll, uint32_t millisec, osaEventFlags_t *pSetFlags) { *pSetFlags = 0; return 0; }
+osaTaskId_t OSA_TaskCreate(osaThreadDef_t *thread_def, osaTaskParam_t task_param) { return (osaTaskId_t)1; }
+uint32_t OSA_TimeGetMsec(void) { return hostNow; }
+void Led2Toggle(void) {}
+void Led3Toggle(void) {}
+void Led4Toggle(void) {}
+bool_t Genfsk_Send(uint8_t ledstate, uint8_t address) { return TRUE; }
+void Genfsk_GetTxStats(ct_tx_stats_t* pStats) { memset(pStats, 0, sizeof(*pStats)); }
+bool_t Genfsk_GetNodeStats(uint8_t address, ct_node_stats_t* pStats) { return FALSE; }
+
+static int hostFailures;
+
+/// report a failed check and keep going, main returns the number of failures
+#define CHECK(cond, ...) do { if ( !(cond) ) { printf("FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); hostFailures++; } } while (0)
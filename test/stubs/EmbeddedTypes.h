@@ -0,0 +1,9 @@
+// Host stand-in for the KW41Z connectivity framework header, just what ppp-webserver.c needs
+#ifndef EMBEDDEDTYPES_H
+#define EMBEDDEDTYPES_H
+#include <stdint.h>
+#include <stdbool.h>
+typedef uint8_t bool_t;
+#define TRUE 1
+#define FALSE 0
+#endif
@@ -0,0 +1,4 @@
+// Host stand-in, genfsk_interface.h includes it but ppp-webserver.c needs nothing from it
+#ifndef FUNCTIONLIB_H
+#define FUNCTIONLIB_H
+#endif
@@ -0,0 +1,7 @@
+// Host stand-in for the board led driver
+#ifndef LED_H
+#define LED_H
+void Led2Toggle(void);
+void Led3Toggle(void);
+void Led4Toggle(void);
+#endif
@@ -0,0 +1,8 @@
+// Host stand-in for the CMSIS intrinsics ppp-webserver.c uses
+#ifndef MKW41Z4_H
+#define MKW41Z4_H
+#include <stdint.h>
+static inline uint32_t __REV(uint32_t x) { return __builtin_bswap32(x); }
+static inline uint32_t __REV16(uint32_t x) { return ((x & 0x00ff00ffu) << 8) | ((x >> 8) & 0x00ff00ffu); }
+static inline void __DMB(void) { __sync_synchronize(); }
+#endif
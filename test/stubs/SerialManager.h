@@ -0,0 +1,13 @@
+// Host stand-in for the serial manager: the tests capture what is written and feed what is read
+#ifndef SERIALMANAGER_H
+#define SERIALMANAGER_H
+#include "EmbeddedTypes.h"
+typedef enum { gSerial_Success_c } serialStatus_t;
+typedef void (*pSerialCallBack_t)(void *);
+#define gAllowToBlock_d 1
+#define gNoBlock_d 0
+serialStatus_t Serial_SyncWrite(uint8_t id, uint8_t *p, uint16_t n);
+serialStatus_t Serial_AsyncWrite(uint8_t id, uint8_t *p, uint16_t n, pSerialCallBack_t cb, void *param);
+serialStatus_t Serial_Read(uint8_t id, uint8_t *p, uint16_t n, uint16_t *count);
+serialStatus_t Serial_Print(uint8_t id, char *s, uint8_t allowToBlock);
+#endif
@@ -0,0 +1,19 @@
+// Host stand-in for the NXP OS abstraction layer, there are no tasks on the host
+#ifndef FSL_OS_ABSTRACTION_H
+#define FSL_OS_ABSTRACTION_H
+#include "EmbeddedTypes.h"
+typedef void * osaEventId_t;
+typedef uint32_t osaEventFlags_t;
+typedef void * osaTaskId_t;
+typedef void * osaTaskParam_t;
+typedef int osaStatus_t;
+typedef struct { void (*task)(osaTaskParam_t); int priority; } osaThreadDef_t;
+#define osaWaitForever_c 0xFFFFFFFFu
+#define OSA_TASK_DEFINE(name, priority, instances, stackSz, useFloat) osaThreadDef_t os_thread_def_##name = { name, priority }
+#define OSA_TASK(name) (&os_thread_def_##name)
+osaEventId_t OSA_EventCreate(bool_t autoClear);
+osaStatus_t OSA_EventSet(osaEventId_t eventId, osaEventFlags_t flagsToSet);
+osaStatus_t OSA_EventWait(osaEventId_t eventId, osaEventFlags_t flagsToWait, bool_t waitAll, uint32_t millisec, osaEventFlags_t *pSetFlags);
+osaTaskId_t OSA_TaskCreate(osaThreadDef_t *thread_def, osaTaskParam_t task_param);
+uint32_t OSA_TimeGetMsec(void);
+#endif
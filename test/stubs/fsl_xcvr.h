@@ -0,0 +1,4 @@
+// Host stand-in, genfsk_interface.h includes it but ppp-webserver.c needs nothing from it
+#ifndef FSL_XCVR_H
+#define FSL_XCVR_H
+#endif